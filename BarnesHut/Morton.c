@@ -0,0 +1,112 @@
+/*! \file    Morton.c
+ *  \brief   Implementation of the Morton (Z-order) keys and their parallel sort.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#include "Morton.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+// The sort takes RADIX_BITS bits of the keys in each pass.
+#define RADIX_BITS 8
+#define RADIX      ( 1 << RADIX_BITS )
+
+
+PUBLIC uint64_t Morton_key( const Box *region, Vector3 position )
+{
+    double   x_min = region->x_interval.min, x_max = region->x_interval.max;
+    double   y_min = region->y_interval.min, y_max = region->y_interval.max;
+    double   z_min = region->z_interval.min, z_max = region->z_interval.max;
+    uint64_t key   = 0;
+
+    // Follow the octree's division of the region (see get_octant and get_region in Octree.c).
+    // The halves are chosen without branches since which is taken is unpredictable.
+    for( int level = 0; level < MORTON_LEVELS; ++level ) {
+        double center_x = ( x_max + x_min ) / 2.0;
+        double center_y = ( y_max + y_min ) / 2.0;
+        double center_z = ( z_max + z_min ) / 2.0;
+        int    below_x  = position.x < center_x;
+        int    below_y  = position.y < center_y;
+        int    below_z  = position.z < center_z;
+
+        x_max = below_x ? center_x : x_max;
+        x_min = below_x ? x_min : center_x;
+        y_max = below_y ? center_y : y_max;
+        y_min = below_y ? y_min : center_y;
+        z_max = below_z ? center_z : z_max;
+        z_min = below_z ? z_min : center_z;
+        key = ( key << 3 ) | (uint64_t)( 4 * below_x + 2 * below_y + below_z );
+    }
+    return key;
+}
+
+
+PUBLIC MortonEntry *Morton_sort( MortonEntry *entries, MortonEntry *scratch, int count,
+                                 int thread_count )
+{
+    // counts[thread][digit] is first the number of the thread's entries with the digit and
+    // then the place in the output of the first of them.
+    size_t (*counts)[RADIX] = malloc( thread_count * sizeof( *counts ) );
+    MortonEntry *result = entries;
+
+    if( counts == NULL ) return NULL;
+
+    #pragma omp parallel num_threads( thread_count )
+    {
+        int thread  = 0;
+        int threads = 1;
+        #if defined(_OPENMP)
+        thread  = omp_get_thread_num( );
+        threads = omp_get_num_threads( );
+        #endif
+
+        // Each thread keeps to its own share of the entries in every pass.
+        int          first = (int)( (long long)count * thread / threads );
+        int          last  = (int)( (long long)count * ( thread + 1 ) / threads );
+        MortonEntry *from  = entries;
+        MortonEntry *to    = scratch;
+        size_t      *mine  = counts[thread];
+
+        for( int shift = 0; shift < 3 * MORTON_LEVELS; shift += RADIX_BITS ) {
+            memset( mine, 0, sizeof( *counts ) );
+            for( int i = first; i < last; ++i ) {
+                ++mine[( from[i].key >> shift ) & ( RADIX - 1 )];
+            }
+            #pragma omp barrier
+
+            // The entries go out in order of digit and, for each digit, in order of thread.
+            #pragma omp single
+            {
+                size_t place = 0;
+                for( int digit = 0; digit < RADIX; ++digit ) {
+                    for( int t = 0; t < threads; ++t ) {
+                        size_t n = counts[t][digit];
+                        counts[t][digit] = place;
+                        place += n;
+                    }
+                }
+            }
+
+            for( int i = first; i < last; ++i ) {
+                to[mine[( from[i].key >> shift ) & ( RADIX - 1 )]++] = from[i];
+            }
+            #pragma omp barrier
+
+            MortonEntry *temp = from;
+            from = to;
+            to   = temp;
+        }
+
+        #pragma omp single
+        result = from;
+    }
+
+    free( counts );
+    return result;
+}
@@ -0,0 +1,60 @@
+/*! \file    Morton.h
+ *  \brief   Interface to the Morton (Z-order) keys of positions in the octree's region.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The octree divides its region in half along each axis, again and again. A Morton key records
+ * the octant a position falls in at each of the first MORTON_LEVELS divisions, three bits per
+ * level with the first division in the highest bits. The octant numbers are those of the
+ * octree (see get_octant in Octree.c) and the halves are computed the same way, so two bodies
+ * share a node of the tree built by insertion exactly when their keys share a prefix. Sorting
+ * the bodies by key therefore puts the contents of every node in one contiguous range, ordered
+ * by octant, and the tree can be built from the sorted keys without searching it (see
+ * Octree_build_sorted).
+ */
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <stdint.h>
+#include "Interval.h"
+#include "Vector3.h"
+
+//! The number of divisions recorded in a key. 21 levels of three bits fill 63 bits.
+#define MORTON_LEVELS 21
+
+//! A body's key and its index in the arrays of bodies.
+typedef struct {
+    uint64_t key;
+    int      index;
+} MortonEntry;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Return the key of 'position' in 'region'. Positions outside the region get the key of the
+//! nearest position inside it.
+uint64_t Morton_key( const Box *region, Vector3 position );
+
+//! Return the octant of level 'level' (zero for the first division) recorded in 'key'.
+static inline int Morton_octant( uint64_t key, int level )
+{
+    return (int)( ( key >> ( 3 * ( MORTON_LEVELS - 1 - level ) ) ) & 7 );
+}
+
+//! Sort 'count' entries into increasing order of key using 'thread_count' threads.
+/*!
+ * The sort is a radix sort, which is stable, so entries with equal keys keep their order.
+ * 'scratch' must have room for 'count' entries.
+ *
+ * \return The array holding the sorted entries ('entries' or 'scratch') or NULL if memory could
+ * not be allocated.
+ */
+MortonEntry *Morton_sort( MortonEntry *entries, MortonEntry *scratch, int count,
+                          int thread_count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
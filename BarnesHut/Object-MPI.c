@@ -25,13 +25,10 @@ void CPU_work_unit( Octree *spacial_tree, int start_index, int stop_index )
     // For each object...
     #pragma omp parallel for
     for( int object_i = start_index; object_i < stop_index; ++object_i ) {
-        Vector3 total_force =
-            Octree_force( spacial_tree,
-                          current_dynamics[object_i].position,
-                          object_array[object_i].mass );
+        Vector3 acceleration   =
+            Octree_acceleration( spacial_tree, current_dynamics[object_i].position );
 
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass );
+        // The acceleration of object_i is now known. Compute velocity and position.
         Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
         Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
 
@@ -44,29 +41,26 @@ void CPU_work_unit( Octree *spacial_tree, int start_index, int stop_index )
 }
 
 
-// WARNING: This is horrible!
-// Break the abstraction of Vector3 so we can explain to MPI the layout of this structure.
-struct HorrifyingHack {
-   double position[3];
-   double velocity[3];
-};
-
-
-// Explain to MPI about the StarDynamics structure.
+// Explain to MPI about the ObjectDynamics structure.
+// Only the x, y, and z components of each vector are described. When Vector3 is padded for SIMD
+// (see Vector3.h) the padding is not sent and the extent is stretched to cover it.
 void build_MPI_dynamics_type( MPI_Datatype *type )
 {
     int          block_lengths[2];
     MPI_Aint     offsets[2];
     MPI_Datatype types[2];
+    MPI_Datatype packed_type;
 
     block_lengths[0] = 3;
     block_lengths[1] = 3;
-    offsets[0] = offsetof( struct HorrifyingHack, position );
-    offsets[1] = offsetof( struct HorrifyingHack, velocity );
+    offsets[0] = offsetof( ObjectDynamics, position );
+    offsets[1] = offsetof( ObjectDynamics, velocity );
     types[0]   = MPI_DOUBLE;
     types[1]   = MPI_DOUBLE;
 
-    MPI_Type_create_struct( 2, block_lengths, offsets, types, type );
+    MPI_Type_create_struct( 2, block_lengths, offsets, types, &packed_type );
+    MPI_Type_create_resized( packed_type, 0, sizeof( ObjectDynamics ), type );
+    MPI_Type_free( &packed_type );
 }
 
 
@@ -98,7 +92,7 @@ void time_step( )
     // Every node builds its own Octree.
     Octree_init( &spacial_tree, &overall_region );
     for( int i = 0; i < OBJECT_COUNT; ++i ) {
-        Octree_insert( &spacial_tree, current_dynamics[i].position, object_array[i].mass );
+        Octree_insert( &spacial_tree, current_dynamics[i].position, object_array[i].mu );
     }
     Octree_refresh_interior( &spacial_tree );
     CPU_work_unit( &spacial_tree, start_index, end_index );
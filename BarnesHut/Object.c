@@ -4,9 +4,16 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <omp.h>
 #include "global.h"
+#include "Integrator.h"
 #include "Octree.h"
+#include "Options.h"
+
+// The number of objects whose forces are checked by approximation_error.
+#define ERROR_SAMPLE_SIZE 100
 
 Box overall_region = {
     .x_interval = { -100.0 * AU, 100.0 * AU },
@@ -14,31 +21,99 @@ Box overall_region = {
     .z_interval = { -100.0 * AU, 100.0 * AU }
 };
 
+// The nodes of every tree come from this arena. It is kept from step to step so that, once it
+// has grown to the size the trees need, building a tree does not allocate memory.
+static NodeArena node_arena;
+
+
+// Start an empty tree using node_arena, first giving the arena a pool for each thread if it
+// has too few (the number of threads can be changed by the tuner).
+static void start_octree( Octree *spacial_tree )
+{
+    int thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+
+    if( node_arena.pool_count < thread_count ) {
+        NodeArena_destroy( &node_arena );
+        if( NodeArena_init( &node_arena, OBJECT_COUNT, thread_count ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the octree nodes\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    Octree_init( spacial_tree, &overall_region, &node_arena );
+}
+
+
+// The bodies' keys, and their positions and masses in arrays of their own, for the sorted
+// builder.
+static MortonEntry morton_entries[OBJECT_COUNT];
+static MortonEntry morton_scratch[OBJECT_COUNT];
+static Vector3     body_positions[OBJECT_COUNT];
+static double      body_mu[OBJECT_COUNT];
+
 
-void build_octree( Octree *spacial_tree )
+// Build the tree from the bodies sorted by their Morton keys. Every phase is divided among the
+// threads.
+static void build_sorted_octree( Octree *spacial_tree, const ObjectDynamics *dynamics )
 {
-    // Builds the Octree.
+    int          thread_count =
+        ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+    MortonEntry *sorted;
+
+    #pragma omp parallel for num_threads( thread_count )
     for( int i = 0; i < OBJECT_COUNT; ++i ) {
-        Octree_insert( spacial_tree, current_dynamics[i].position, object_array[i].mass );
+        body_positions[i] = dynamics[i].position;
+        body_mu[i]        = object_array[i].mu;
+        morton_entries[i].key   = Morton_key( &overall_region, dynamics[i].position );
+        morton_entries[i].index = i;
+    }
+
+    sorted = Morton_sort( morton_entries, morton_scratch, OBJECT_COUNT, thread_count );
+    if( sorted == NULL || Octree_build_sorted( spacial_tree, sorted, OBJECT_COUNT,
+                              body_positions, body_mu, thread_count ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the octree nodes\n" );
+        exit( EXIT_FAILURE );
     }
-    Octree_refresh_interior( spacial_tree );
 }
 
 
-void compute_forces( Octree *spacial_tree )
+void build_octree( Octree *spacial_tree, const ObjectDynamics *dynamics )
 {
+    if( options.tree_builder == TREE_MORTON ) {
+        build_sorted_octree( spacial_tree, dynamics );
+        return;
+    }
+
+    int thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+    int status       = 0;
+
+    // Builds the Octree. The threads insert at once (see Octree_insert).
+    #pragma omp parallel for num_threads( thread_count ) reduction( min : status )
+    for( int i = 0; i < OBJECT_COUNT; ++i ) {
+        int result = Octree_insert( spacial_tree, dynamics[i].position, object_array[i].mu );
+        if( result < status ) status = result;
+    }
+    if( status != 0 ) {
+        fprintf( stderr, "Unable to allocate the octree nodes\n" );
+        exit( EXIT_FAILURE );
+    }
+    Octree_refresh_interior( spacial_tree, thread_count );
+}
+
+
+void compute_forces( Octree *spacial_tree, double step )
+{
+    // Unless the options say otherwise, the team size is OpenMP's default.
+    int thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+
     // For each object...
-    #pragma omp parallel for
+    #pragma omp parallel for num_threads( thread_count )
     for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
-        Vector3 total_force =
-            Octree_force( spacial_tree,
-                          current_dynamics[object_i].position,
-                          object_array[object_i].mass );
+        Vector3 acceleration   =
+            Octree_acceleration( spacial_tree, current_dynamics[object_i].position );
 
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass );
-        Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
-        Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
+        // The acceleration of object_i is now known. Compute velocity and position.
+        Vector3 delta_v        = v3_multiply( step, acceleration );
+        Vector3 delta_position = v3_multiply( step, current_dynamics[object_i].velocity );
 
         next_dynamics[object_i].velocity =
             v3_add( current_dynamics[object_i].velocity, delta_v );
@@ -49,13 +124,151 @@ void compute_forces( Octree *spacial_tree )
 }
 
 
-void time_step( )
+double mixed_precision_error( )
+{
+    Octree spacial_tree;
+    enum Precision saved_precision = options.precision;
+    double maximum_error = 0.0;
+
+    start_octree( &spacial_tree );
+    build_octree( &spacial_tree, current_dynamics );
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        options.precision = PRECISION_MIXED;
+        Vector3 mixed_acceleration =
+            Octree_acceleration( &spacial_tree, current_dynamics[object_i].position );
+        options.precision = PRECISION_DOUBLE;
+        Vector3 double_acceleration =
+            Octree_acceleration( &spacial_tree, current_dynamics[object_i].position );
+
+        Vector3 difference = v3_subtract( mixed_acceleration, double_acceleration );
+        double  magnitude  = sqrt( magnitude_squared( double_acceleration ) );
+        if( magnitude > 0.0 ) {
+            double error = sqrt( magnitude_squared( difference ) ) / magnitude;
+            if( error > maximum_error ) maximum_error = error;
+        }
+    }
+    options.precision = saved_precision;
+
+    Octree_destroy( &spacial_tree );
+    return maximum_error;
+}
+
+
+double approximation_error( )
 {
     Octree spacial_tree;
-    Octree_init( &spacial_tree, &overall_region );
+    int    stride = ( OBJECT_COUNT > ERROR_SAMPLE_SIZE ) ? OBJECT_COUNT / ERROR_SAMPLE_SIZE : 1;
+    double maximum_error = 0.0;
+
+    start_octree( &spacial_tree );
+    build_octree( &spacial_tree, current_dynamics );
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; object_i += stride ) {
+        Vector3 position = current_dynamics[object_i].position;
+        Vector3 tree_acceleration = Octree_acceleration( &spacial_tree, position );
+        Vector3 exact_acceleration = { 0.0, 0.0, 0.0 };
+
+        for( int object_j = 0; object_j < OBJECT_COUNT; ++object_j ) {
+            if( object_j == object_i ) continue;
+            Vector3 displacement = v3_subtract( current_dynamics[object_j].position, position );
+            double  distance_squared = magnitude_squared( displacement );
+            double  scale =
+                object_array[object_j].mu / ( distance_squared * sqrt( distance_squared ) );
+            exact_acceleration =
+                v3_add( exact_acceleration, v3_multiply( scale, displacement ) );
+        }
+
+        Vector3 difference = v3_subtract( tree_acceleration, exact_acceleration );
+        double  magnitude  = sqrt( magnitude_squared( exact_acceleration ) );
+        if( magnitude > 0.0 ) {
+            double error = sqrt( magnitude_squared( difference ) ) / magnitude;
+            if( error > maximum_error ) maximum_error = error;
+        }
+    }
+
+    Octree_destroy( &spacial_tree );
+    return maximum_error;
+}
+
+
+// Compute the accelerations of all objects at the positions in 'dynamics'. The jerks are only
+// wanted by the Hermite method, which main rejects.
+void compute_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
+{
+    Octree spacial_tree;
+    int    thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+
+    (void)jerks;
+    start_octree( &spacial_tree );
+    build_octree( &spacial_tree, dynamics );
+
+    #pragma omp parallel for num_threads( thread_count )
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        accelerations[object_i] =
+            Octree_acceleration( &spacial_tree, dynamics[object_i].position );
+    }
+    Octree_destroy( &spacial_tree );
+}
+
+
+// Compute the accelerations of the active objects at the positions in 'dynamics'. The tree
+// holds every object but only the active ones are traversed.
+void compute_active_accelerations( const ObjectDynamics *dynamics,
+    const int *active, int active_count, Vector3 *accelerations )
+{
+    Octree spacial_tree;
+    int    thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+
+    start_octree( &spacial_tree );
+    build_octree( &spacial_tree, dynamics );
+
+    #pragma omp parallel for num_threads( thread_count )
+    for( int i = 0; i < active_count; ++i ) {
+        accelerations[active[i]] =
+            Octree_acceleration( &spacial_tree, dynamics[active[i]].position );
+    }
+    Octree_destroy( &spacial_tree );
+}
+
+
+double time_step( double maximum )
+{
+    double step = ( options.time_step < maximum ) ? options.time_step : maximum;
+
+    // Every block step must have the same base step (see Integrator_block_step) so it is not
+    // shortened to fit 'maximum'.
+    if( options.integrator == INTEGRATOR_BLOCK ) {
+        step = options.time_step;
+        if( Integrator_block_step( compute_active_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+    if( options.step_control == STEP_ADAPTIVE ) {
+        step = Integrator_choose_step( compute_accelerations, step );
+        if( step < 0.0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    // Choosing the step computed the forces. The integrator's Euler step uses them.
+    if( options.integrator != INTEGRATOR_EULER || options.step_control == STEP_ADAPTIVE ) {
+        if( Integrator_step( compute_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+
+    Octree spacial_tree;
 
-    build_octree( &spacial_tree );
-    compute_forces( &spacial_tree );
+    start_octree( &spacial_tree );
+    build_octree( &spacial_tree, current_dynamics );
+    compute_forces( &spacial_tree, step );
 
     // Swap the dynamics arrays.
     ObjectDynamics *temp = current_dynamics;
@@ -64,6 +277,7 @@ void time_step( )
 
     // Clean up the Octree.
     Octree_destroy( &spacial_tree );
+    return step;
 }
 
 
@@ -5,24 +5,131 @@
 
 #include <math.h>
 #include <stdlib.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 #include "Octree.h"
+#include "Options.h"
 
 #define TRUE  1
 #define FALSE 0
-#define G     6.673E-11   // Gravitational constant in MKS units.
+#define G     6.673E-11          // Gravitational constant in MKS units.
+#define AU    1.49597870700E+11  // Meters per astronomical unit.
+
+// A double precision sum with Neumaier's compensation for each component.
+struct CompensatedSum {
+    double sum[3];
+    double compensation[3];
+};
 
 #define PRIVATE // static
 #define PUBLIC
 
-PRIVATE void subtree_destroy( struct OctreeNode *subtree )
+// A block of nodes in a pool. The nodes before 'used' have been handed out since the reset.
+struct NodeChunk {
+    struct NodeChunk  *next;
+    size_t             used;
+    size_t             capacity;
+    struct OctreeNode  nodes[];
+};
+
+// The fewest nodes in a chunk. Small chunks would make small problems call malloc often.
+#define MINIMUM_CHUNK 64
+
+
+PRIVATE struct NodeChunk *new_chunk( size_t capacity )
 {
-    int i;
+    struct NodeChunk *chunk = (struct NodeChunk *)malloc(
+        sizeof(struct NodeChunk) + capacity * sizeof(struct OctreeNode) );
+
+    if( chunk == NULL ) return NULL;
+    chunk->next     = NULL;
+    chunk->used     = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
 
-    if( subtree == NULL ) return;
-    for( i = 0; i < 8; ++i ) {
-        subtree_destroy( subtree->octants[i] );
+
+PUBLIC int NodeArena_init( NodeArena *arena, int body_count, int thread_count )
+{
+    // A tree usually has fewer interior nodes than leaves. Twice the body count is enough for
+    // most trees, and the pools grow when it is not.
+    size_t chunk_size = 2 * (size_t)body_count / thread_count;
+
+    if( chunk_size < MINIMUM_CHUNK ) chunk_size = MINIMUM_CHUNK;
+    arena->pool_count = 0;
+    arena->pools = (NodePool *)malloc( thread_count * sizeof(NodePool) );
+    if( arena->pools == NULL ) return -1;
+
+    for( int i = 0; i < thread_count; ++i ) {
+        arena->pools[i].first   = new_chunk( chunk_size );
+        arena->pools[i].current = arena->pools[i].first;
+        if( arena->pools[i].first == NULL ) {
+            NodeArena_destroy( arena );
+            return -1;
+        }
+        ++arena->pool_count;
+    }
+    return 0;
+}
+
+
+PUBLIC void NodeArena_reset( NodeArena *arena )
+{
+    // The later chunks are emptied when they are reached again.
+    for( int i = 0; i < arena->pool_count; ++i ) {
+        arena->pools[i].current = arena->pools[i].first;
+        arena->pools[i].first->used = 0;
+    }
+}
+
+
+PUBLIC void NodeArena_destroy( NodeArena *arena )
+{
+    for( int i = 0; i < arena->pool_count; ++i ) {
+        struct NodeChunk *chunk = arena->pools[i].first;
+
+        while( chunk != NULL ) {
+            struct NodeChunk *next = chunk->next;
+            free( chunk );
+            chunk = next;
+        }
+    }
+    free( arena->pools );
+
+    // Put the left over arena into a well defined state.
+    arena->pools      = NULL;
+    arena->pool_count = 0;
+}
+
+
+// Returns a node from the calling thread's pool, or NULL if memory is exhausted. The node's
+// members are not initialized.
+PRIVATE struct OctreeNode *allocate_node( NodeArena *arena )
+{
+    int pool_index = 0;
+
+    // Threads without a pool of their own share the first, so they must not insert at once.
+    #if defined(_OPENMP)
+    pool_index = omp_get_thread_num( );
+    if( pool_index >= arena->pool_count ) pool_index = 0;
+    #endif
+
+    NodePool         *pool  = &arena->pools[pool_index];
+    struct NodeChunk *chunk = pool->current;
+
+    if( chunk->used == chunk->capacity ) {
+        // Chunks added during earlier steps are used again before any more are made.
+        if( chunk->next == NULL && ( chunk->next = new_chunk( chunk->capacity ) ) == NULL )
+            return NULL;
+        chunk = chunk->next;
+        chunk->used   = 0;
+        pool->current = chunk;
     }
-    free( subtree );
+    return &chunk->nodes[chunk->used++];
 }
 
 //  x > 0, y > 0, z > 0  ==> 0
@@ -109,7 +216,9 @@ PRIVATE Box get_region( struct OctreeNode *overall, int octant_index )
 }
 
 
-PRIVATE void subtree_insert( struct OctreeNode *current, struct OctreeNode *new_node )
+// Returns 0 if successful or -1 if a node could not be allocated.
+PRIVATE int subtree_insert(
+    NodeArena *arena, struct OctreeNode *current, struct OctreeNode *new_node )
 {
     int octant_index;
 
@@ -119,56 +228,116 @@ PRIVATE void subtree_insert( struct OctreeNode *current, struct OctreeNode *new_
         if( current->octants[octant_index] == NULL ) {
             new_node->region = get_region( current, octant_index );
             current->octants[octant_index] = new_node;
+            return 0;
         }
-        else {
-            subtree_insert( current->octants[octant_index], new_node );
-        }
+        return subtree_insert( arena, current->octants[octant_index], new_node );
     }
     else {
         // Subdivide the curent node.
-        struct OctreeNode *subnode = (struct OctreeNode *)malloc( sizeof(struct OctreeNode) );
-        // TODO: What if subnode == NULL?
+        struct OctreeNode *subnode = allocate_node( arena );
+        if( subnode == NULL ) return -1;
         *subnode = *current;
         current->is_leaf = FALSE;
-        subtree_insert( current, subnode );    // Insert original item into appropriate octant.
-        subtree_insert( current, new_node );   // Retry at the current node.
+        // Insert original item into appropriate octant.
+        if( subtree_insert( arena, current, subnode ) != 0 ) return -1;
+        return subtree_insert( arena, current, new_node );   // Retry at the current node.
     }
 }
 
 
-PRIVATE void subtree_refresh( struct OctreeNode *node )
+// Computes the mass, body count, and center of mass of an interior node from its children.
+PRIVATE void summarize( struct OctreeNode *node )
 {
     double x = 0.0, y = 0.0, z = 0.0;
 
-    if( node->is_leaf ) return;
+    node->mu = 0.0;
+    node->body_count = 0;
+    for( int i = 0; i < 8; ++i ) {
+        if( node->octants[i] != NULL ) {
+            node->mu += node->octants[i]->mu;
+            node->body_count += node->octants[i]->body_count;
+            x += node->octants[i]->center_of_mass.x * node->octants[i]->mu;
+            y += node->octants[i]->center_of_mass.y * node->octants[i]->mu;
+            z += node->octants[i]->center_of_mass.z * node->octants[i]->mu;
+        }
+    }
+    node->center_of_mass.x = x / node->mu;
+    node->center_of_mass.y = y / node->mu;
+    node->center_of_mass.z = z / node->mu;
 
-    node->total_mass = 0.0;
+    // Each octant's bodies are within its radius of its center of mass.
+    node->radius = 0.0;
     for( int i = 0; i < 8; ++i ) {
         if( node->octants[i] != NULL ) {
-            subtree_refresh( node->octants[i] );
-            node->total_mass += node->octants[i]->total_mass;
-            x += node->octants[i]->center_of_mass.x * node->octants[i]->total_mass;
-            y += node->octants[i]->center_of_mass.y * node->octants[i]->total_mass;
-            z += node->octants[i]->center_of_mass.z * node->octants[i]->total_mass;
+            Vector3 offset =
+                v3_subtract( node->octants[i]->center_of_mass, node->center_of_mass );
+            double  reach  = sqrt( magnitude_squared( offset ) ) + node->octants[i]->radius;
+            if( reach > node->radius ) node->radius = reach;
         }
     }
-    node->center_of_mass.x = x / node->total_mass;
-    node->center_of_mass.y = y / node->total_mass;
-    node->center_of_mass.z = z / node->total_mass;
 }
 
 
-PRIVATE Vector3 subtree_force( struct OctreeNode *node, Vector3 position, double mass )
+PRIVATE void subtree_refresh( struct OctreeNode *node )
+{
+    if( node->is_leaf ) return;
+
+    for( int i = 0; i < 8; ++i ) {
+        if( node->octants[i] != NULL ) subtree_refresh( node->octants[i] );
+    }
+    summarize( node );
+}
+
+
+// Interior nodes shallower than this are refreshed by tasks of their own. The bodies are seldom
+// spread evenly, so there are more tasks than threads to balance the load; each is still large
+// enough to be worth its overhead.
+#define REFRESH_TASK_DEPTH 3
+
+
+// Like subtree_refresh but the octants of nodes at depths less than REFRESH_TASK_DEPTH are
+// refreshed in parallel. Below that depth each task works bottom-up by itself.
+PRIVATE void subtree_refresh_parallel( struct OctreeNode *node, int depth )
 {
-    static const double theta = 0.5;
-    Vector3 force = { 0.0, 0.0, 0.0 };
+    if( node->is_leaf ) return;
 
-    // Ignore this node if it's the node containing the object under consideration.
+    for( int i = 0; i < 8; ++i ) {
+        struct OctreeNode *octant = node->octants[i];
+
+        if( octant == NULL || octant->is_leaf ) continue;
+        if( depth + 1 < REFRESH_TASK_DEPTH ) {
+            #pragma omp task
+            subtree_refresh_parallel( octant, depth + 1 );
+        }
+        else {
+            #pragma omp task
+            subtree_refresh( octant );
+        }
+    }
+    #pragma omp taskwait
+    summarize( node );
+}
+
+
+// Returns TRUE if 'node' is the leaf holding the object at 'position'.
+PRIVATE int is_self( struct OctreeNode *node, Vector3 position )
+{
     // TODO: These comparisons are not safe for floating point numbers.
-    if( node->is_leaf &&
+    return node->is_leaf &&
         node->center_of_mass.x == position.x &&
         node->center_of_mass.y == position.y &&
-        node->center_of_mass.z == position.z) return force;
+        node->center_of_mass.z == position.z;
+}
+
+
+// Returns TRUE if the acceleration due to 'node' can be computed from its total mu alone.
+PRIVATE int is_distant( struct OctreeNode *node, Vector3 position )
+{
+    if( node->is_leaf ) return TRUE;
+
+    // Regions with only a few bodies are always opened. Summing the bodies directly costs
+    // little more than testing the distance and the result is exact.
+    if( node->body_count <= options.leaf_size ) return FALSE;
 
     double d  = sqrt( magnitude_squared( v3_subtract(node->center_of_mass, position) ) );
     double sx = node->region.x_interval.max - node->region.x_interval.min;
@@ -183,85 +352,363 @@ PRIVATE Vector3 subtree_force( struct OctreeNode *node, Vector3 position, double
         s = (sy > sz) ? sy : sz;
     }
 
+    // A region "far enough" away from the object allows the direct computation. The radius of
+    // the bodies is never more than, and often much less than, that of the region.
+    if( options.opening == OPENING_RADIUS ) return 2.0 * node->radius < options.theta * d;
+    return s/d < options.theta;
+}
+
+
+// Returns 1 / sqrt( x ) computed from the processor's approximate reciprocal square root
+// (where available) refined by 'iterations' Newton-Raphson steps.
+PRIVATE double reciprocal_sqrt( double x, int iterations )
+{
+    #if defined(__SSE__)
+    double y = _mm_cvtss_f32( _mm_rsqrt_ss( _mm_set_ss( (float)x ) ) );
+    #else
+    double y = 1.0 / sqrt( x );
+    #endif
+
+    for( int i = 0; i < iterations; ++i ) {
+        y = y * ( 1.5 - 0.5 * x * y * y );
+    }
+    return y;
+}
+
+
+PRIVATE Vector3 subtree_acceleration( struct OctreeNode *node, Vector3 position )
+{
+    Vector3 acceleration = { 0.0, 0.0, 0.0 };
+
+    // Ignore this node if it's the node containing the object under consideration.
+    if( is_self( node, position ) ) return acceleration;
+
     // If this region is a leaf or "far enough" away from the object, do the direct computation.
-    if( node->is_leaf || s/d < theta) {
+    if( is_distant( node, position ) ) {
         Vector3 displacement = v3_subtract( node->center_of_mass, position );
         double distance_squared = magnitude_squared( displacement );
-        double distance = sqrt( distance_squared );
-        double force_magnitude = ( G * mass * node->total_mass ) / distance_squared;
-        force = v3_multiply( (force_magnitude / distance ), displacement );
+
+        // The fast path replaces the square root and the division with multiplications.
+        if( options.rsqrt_iterations > 0 ) {
+            double inverse = reciprocal_sqrt( distance_squared, options.rsqrt_iterations );
+            double inverse_cubed = inverse * inverse * inverse;
+            acceleration = v3_multiply( node->mu * inverse_cubed, displacement );
+        }
+        else {
+            double distance = sqrt( distance_squared );
+            double scale    = node->mu / ( distance_squared * distance );
+            acceleration = v3_multiply( scale, displacement );
+        }
     }
     // Otherwise recursively examine the octants.
     else {
         for( int i = 0; i < 8; ++i ) {
             if( node->octants[i] != NULL ) {
-                force = v3_add( force, subtree_force( node->octants[i], position, mass ) );
+                acceleration =
+                    v3_add( acceleration, subtree_acceleration( node->octants[i], position ) );
+            }
+        }
+    }
+    return acceleration;
+}
+
+
+PRIVATE void compensated_add( struct CompensatedSum *total, int component, double value )
+{
+    double *sum          = &total->sum[component];
+    double *compensation = &total->compensation[component];
+    double  result       = *sum + value;
+
+    if( fabs( *sum ) >= fabs( value ) )
+        *compensation += ( *sum - result ) + value;
+    else
+        *compensation += ( value - result ) + *sum;
+    *sum = result;
+}
+
+
+// Like subtree_acceleration but the separation and inverse distance are computed in single
+// precision (in astronomical units, relative to the object) and the results are added to
+// 'total'. The conversion back from astronomical units is left for the caller to apply.
+PRIVATE void subtree_acceleration_mixed(
+    struct OctreeNode *node, Vector3 position, struct CompensatedSum *total )
+{
+    if( is_self( node, position ) ) return;
+
+    if( is_distant( node, position ) ) {
+        float dx = (float)( ( node->center_of_mass.x - position.x ) / AU );
+        float dy = (float)( ( node->center_of_mass.y - position.y ) / AU );
+        float dz = (float)( ( node->center_of_mass.z - position.z ) / AU );
+        float distance_squared = dx * dx + dy * dy + dz * dz;
+        float inverse = 1.0f / sqrtf( distance_squared );
+        float scale   = inverse * inverse * inverse;
+
+        compensated_add( total, 0, node->mu * (double)( scale * dx ) );
+        compensated_add( total, 1, node->mu * (double)( scale * dy ) );
+        compensated_add( total, 2, node->mu * (double)( scale * dz ) );
+    }
+    else {
+        for( int i = 0; i < 8; ++i ) {
+            if( node->octants[i] != NULL ) {
+                subtree_acceleration_mixed( node->octants[i], position, total );
             }
         }
     }
-    return force;
 }
 
 
-PUBLIC void Octree_init( Octree *tree, Box *overall_region )
+PUBLIC void Octree_init( Octree *tree, Box *overall_region, NodeArena *arena )
 {
     // Provide default initial values.
     tree->root           =  NULL;
     tree->overall_region = *overall_region;
+    tree->arena          =  arena;
+}
+
+
+// Returns the node in 'slot'. Another thread may be storing to the slot at the same time; the
+// node's contents are complete once it can be seen.
+PRIVATE struct OctreeNode *load_slot( struct OctreeNode **slot )
+{
+    return __atomic_load_n( slot, __ATOMIC_ACQUIRE );
 }
 
 
-PUBLIC int Octree_insert( Octree *tree, Vector3 position, double mass )
+// Stores 'node' in 'slot' if the slot still holds 'expected'. Returns TRUE if it did. The
+// contents of 'node' must be complete: other threads may read them as soon as it is stored.
+PRIVATE int replace_slot(
+    struct OctreeNode **slot, struct OctreeNode *expected, struct OctreeNode *node )
+{
+    return __atomic_compare_exchange_n(
+        slot, &expected, node, FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED );
+}
+
+
+// Nodes are never changed once they are in the tree, so any number of threads may insert at
+// once without locks. A thread claims an empty octant by storing its leaf there only if the
+// octant is still empty. A leaf in the way is split by replacing it, in the same way, with an
+// interior node that holds a copy of it. If another thread changed the octant first the thread
+// looks at the octant again; the nodes it prepared are kept for the next try.
+PUBLIC int Octree_insert( Octree *tree, Vector3 position, double mu )
 {
     int i;
-    struct OctreeNode *new_node;
+    struct OctreeNode  *new_node;
+    struct OctreeNode  *interior = NULL;
+    struct OctreeNode  *copy     = NULL;
+    struct OctreeNode **slot     = &tree->root;
+    Box                 region   = tree->overall_region;
 
     // Set up the new node.
-    new_node = (struct OctreeNode *)malloc( sizeof( struct OctreeNode ) );
+    new_node = allocate_node( tree->arena );
     if( new_node == NULL ) return -1;
     for( i = 0; i < 8; ++i ) {
         new_node->octants[i] = NULL;
     }
     new_node->is_leaf = TRUE;
     new_node->center_of_mass = position;
-    new_node->total_mass = mass;
-    // new_node->region will be defined later.
+    new_node->mu = mu;
+    new_node->body_count = 1;
+    new_node->radius = 0.0;
 
     // Add it to the tree.
-    if( tree->root == NULL ) {
-        new_node->region = tree->overall_region;
-        tree->root = new_node;
+    while( TRUE ) {
+        struct OctreeNode *current = load_slot( slot );
+
+        if( current == NULL ) {
+            new_node->region = region;
+            if( replace_slot( slot, NULL, new_node ) ) return 0;
+        }
+        else if( !current->is_leaf ) {
+            int octant_index = get_octant( current, new_node );
+            region = get_region( current, octant_index );
+            slot   = &current->octants[octant_index];
+        }
+        else {
+            // Subdivide the current node.
+            if( interior == NULL && ( interior = allocate_node( tree->arena ) ) == NULL )
+                return -1;
+            if( copy == NULL && ( copy = allocate_node( tree->arena ) ) == NULL ) return -1;
+            for( i = 0; i < 8; ++i ) {
+                interior->octants[i] = NULL;
+            }
+            interior->is_leaf    = FALSE;
+            interior->region     = current->region;
+            interior->mu         = 0.0;
+            interior->body_count = 0;
+            interior->radius     = 0.0;
+            *copy = *current;
+
+            // Insert original item into appropriate octant.
+            int octant_index = get_octant( interior, copy );
+            copy->region = get_region( interior, octant_index );
+            interior->octants[octant_index] = copy;
+
+            // Retry at the current node.
+            if( replace_slot( slot, current, interior ) ) {
+                interior = NULL;
+                copy     = NULL;
+            }
+        }
     }
-    else {
-        subtree_insert( tree->root, new_node );
+}
+
+
+// Ranges of more bodies than this are built by a task of their own.
+#define TASK_CUTOFF 256
+
+
+// Makes 'node' a leaf holding one body. The region is left for the caller to set.
+PRIVATE void make_leaf( struct OctreeNode *node, Vector3 position, double mu )
+{
+    for( int i = 0; i < 8; ++i ) {
+        node->octants[i] = NULL;
     }
-    return 0;
+    node->is_leaf = TRUE;
+    node->center_of_mass = position;
+    node->mu = mu;
+    node->body_count = 1;
+    node->radius = 0.0;
 }
 
 
-PUBLIC void Octree_refresh_interior( Octree *tree )
+// Returns the index of the first of entries[first..last) in an octant after 'octant' at
+// 'level'.
+// The entries must be sorted and share the octants of the levels before 'level'.
+PRIVATE int octant_end( const MortonEntry *entries, int first, int last, int level, int octant )
 {
-    if( tree->root != NULL ) {
-        subtree_refresh( tree->root );
+    while( first < last ) {
+        int middle = first + ( last - first ) / 2;
+        if( Morton_octant( entries[middle].key, level ) <= octant )
+            first = middle + 1;
+        else
+            last = middle;
     }
+    return first;
 }
 
 
-PUBLIC Vector3 Octree_force( Octree *tree, Vector3 position, double mass )
+// Builds the subtree below 'node' holding the bodies entries[first..last), of which there are
+// at least two. Their keys share the octants of the levels before 'level'. The region of 'node'
+// must be set. Returns 0 if successful or -1 if a node could not be allocated.
+PRIVATE int build_range( NodeArena *arena, struct OctreeNode *node,
+                         const MortonEntry *entries, int first, int last, int level,
+                         const Vector3 *positions, const double *mu )
 {
-    Vector3 force = { 0.0, 0.0, 0.0 };
+    int status = 0;
+
+    // The keys cannot tell these bodies apart. They are inserted as Octree_insert would.
+    if( level == MORTON_LEVELS ) {
+        make_leaf( node, positions[entries[first].index], mu[entries[first].index] );
+        for( int i = first + 1; i < last; ++i ) {
+            struct OctreeNode *leaf = allocate_node( arena );
+            if( leaf == NULL ) return -1;
+            make_leaf( leaf, positions[entries[i].index], mu[entries[i].index] );
+            if( subtree_insert( arena, node, leaf ) != 0 ) return -1;
+        }
+        subtree_refresh( node );
+        return 0;
+    }
+
+    for( int i = 0; i < 8; ++i ) {
+        node->octants[i] = NULL;
+    }
+    node->is_leaf = FALSE;
+
+    for( int start = first; start < last; ) {
+        int octant = Morton_octant( entries[start].key, level );
+        int end    = octant_end( entries, start, last, level, octant );
+        struct OctreeNode *child = allocate_node( arena );
+
+        // Tasks already started may be setting the status at the same time.
+        if( child == NULL ) {
+            #pragma omp atomic write
+            status = -1;
+            break;
+        }
+        if( end - start == 1 )
+            make_leaf( child, positions[entries[start].index], mu[entries[start].index] );
+        child->region = get_region( node, octant );
+        node->octants[octant] = child;
+
+        // The octants are independent. Large ones are built while this thread goes on.
+        if( end - start > 1 ) {
+            #pragma omp task if( end - start > TASK_CUTOFF ) shared( status )
+            {
+                if( build_range(
+                        arena, child, entries, start, end, level + 1, positions, mu ) != 0 ) {
+                    #pragma omp atomic write
+                    status = -1;
+                }
+            }
+        }
+        start = end;
+    }
+    #pragma omp taskwait
+
+    if( status == 0 ) summarize( node );
+    return status;
+}
+
 
+PUBLIC int Octree_build_sorted( Octree *tree, const MortonEntry *entries, int count,
+                                const Vector3 *positions, const double *mu, int thread_count )
+{
+    struct OctreeNode *root;
+    int status = 0;
+
+    if( count == 0 ) return 0;
+    if( ( root = allocate_node( tree->arena ) ) == NULL ) return -1;
+    root->region = tree->overall_region;
+    tree->root   = root;
+    if( count == 1 ) {
+        make_leaf( root, positions[entries[0].index], mu[entries[0].index] );
+        return 0;
+    }
+
+    #pragma omp parallel num_threads( thread_count )
+    #pragma omp single
+    status = build_range( tree->arena, root, entries, 0, count, 0, positions, mu );
+
+    return status;
+}
+
+
+PUBLIC void Octree_refresh_interior( Octree *tree, int thread_count )
+{
     if( tree->root != NULL ) {
-        force = subtree_force( tree->root, position, mass );
+        #pragma omp parallel num_threads( thread_count )
+        #pragma omp single
+        subtree_refresh_parallel( tree->root, 0 );
+    }
+}
+
+
+PUBLIC Vector3 Octree_acceleration( Octree *tree, Vector3 position )
+{
+    Vector3 acceleration = { 0.0, 0.0, 0.0 };
+
+    if( tree->root == NULL ) return acceleration;
+
+    if( options.precision == PRECISION_MIXED ) {
+        struct CompensatedSum total = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+        double factor = 1.0 / ( AU * AU );
+
+        subtree_acceleration_mixed( tree->root, position, &total );
+        acceleration.x = factor * ( total.sum[0] + total.compensation[0] );
+        acceleration.y = factor * ( total.sum[1] + total.compensation[1] );
+        acceleration.z = factor * ( total.sum[2] + total.compensation[2] );
+    }
+    else {
+        acceleration = subtree_acceleration( tree->root, position );
     }
-    return force;
+    return acceleration;
 }
 
 
 PUBLIC void Octree_destroy( Octree *tree )
 {
-    // Deallocate all the tree nodes.
-    subtree_destroy( tree->root );
+    // Return all the tree nodes to the arena at once.
+    NodeArena_reset( tree->arena );
 
     // Put the left over tree object into a well defined state.
     tree->root  = NULL;
@@ -6,7 +6,9 @@
 #ifndef OCTREE_H
 #define OCTREE_H
 
+#include <stddef.h>
 #include "Interval.h"
+#include "Morton.h"
 #include "Vector3.h"
 
 struct OctreeNode {
@@ -14,18 +16,52 @@ struct OctreeNode {
     int     is_leaf;
     Box     region;
     Vector3 center_of_mass;
-    double  total_mass;
+    double  mu;             // Gravitational parameter (G times the total mass) of the region.
+    int     body_count;     // Number of bodies in the region.
+    double  radius;         // Every body is within this distance of the center of mass.
 };
 
+struct NodeChunk;
+
+// The nodes taken by one thread. They are handed out in order from a list of chunks.
+typedef struct {
+    struct NodeChunk *first;    // The first chunk of the list.
+    struct NodeChunk *current;  // The chunk nodes are now taken from.
+} NodePool;
+
+// The nodes of a tree, released all at once. Building a tree once took a malloc for every node
+// and destroying it a free for each. The arena is instead sized from the number of bodies and
+// kept from step to step; after the first few steps building a tree calls malloc not at all.
+// Each thread takes nodes from its own pool so a tree may be built by several threads at once.
+typedef struct {
+    NodePool *pools;        // One pool for each thread.
+    int       pool_count;
+} NodeArena;
+
 typedef struct {
     struct OctreeNode *root;
     Box    overall_region;
+    NodeArena *arena;       // Where the nodes come from. Only one tree may use it at a time.
 } Octree;
 
-void    Octree_init( Octree *tree, Box *overall_region );
-int     Octree_insert( Octree *tree, Vector3 position, double mass );
-void    Octree_refresh_interior( Octree *tree );
-Vector3 Octree_force( Octree *tree, Vector3 position, double mass );
+int     NodeArena_init( NodeArena *arena, int body_count, int thread_count );
+void    NodeArena_reset( NodeArena *arena );
+void    NodeArena_destroy( NodeArena *arena );
+
+void    Octree_init( Octree *tree, Box *overall_region, NodeArena *arena );
+// Any number of threads may insert into a tree at once. The arena must have a pool for each.
+int     Octree_insert( Octree *tree, Vector3 position, double mu );
+
+// Build the tree of 'count' bodies from their entries sorted by key (see Morton.h) using
+// 'thread_count' threads. The body of an entry has the position and mu at its index in
+// 'positions' and 'mu'. The tree is the one inserting the bodies would build, with the
+// interior already refreshed. The arena must have a pool for each thread.
+int     Octree_build_sorted( Octree *tree, const MortonEntry *entries, int count,
+                             const Vector3 *positions, const double *mu, int thread_count );
+// Compute the masses, centers of mass, and radii of the interior nodes using 'thread_count'
+// threads.
+void    Octree_refresh_interior( Octree *tree, int thread_count );
+Vector3 Octree_acceleration( Octree *tree, Vector3 position );
 void    Octree_destroy( Octree *tree );
 
 #endif
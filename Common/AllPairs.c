@@ -0,0 +1,641 @@
+/*! \file    AllPairs.c
+ *  \brief   Implementation of the portable all-pairs kernels and of kernel selection.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "AllPairs.h"
+#include "AllPairsKernels.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+PRIVATE enum AllPairsISA selected_isa = ALLPAIRS_SCALAR;
+PRIVATE void ( *selected_forces )( BodyStore *, int, int ) = AllPairs_forces_scalar;
+PRIVATE void ( *selected_symmetric )(
+    const BodyStore *, int, int, double *, double *, double * ) = AllPairs_symmetric_scalar;
+PRIVATE void ( *selected_block )( BodyStore *, int, int, int, int ) = AllPairs_block_scalar;
+PRIVATE void ( *selected_mixed )( MixedTile * ) = AllPairs_mixed_scalar;
+PRIVATE const AllPairsFixedKernel *selected_fixed = AllPairs_fixed_scalar;
+PRIVATE void ( *selected_ensemble )( Ensemble *, int ) = AllPairs_ensemble_scalar;
+PRIVATE void ( *selected_hermite )( BodyStore *, int, int, int, int ) = AllPairs_hermite_scalar;
+
+// The method in use for the current step. Mixed precision is only implemented by the tiled
+// method so selecting it overrides options.force_method.
+PRIVATE enum ForceMethod active_method = FORCE_DIRECT;
+
+// Nonzero if the jerks are computed along with the accelerations in the current step.
+PRIVATE int active_jerk = 0;
+
+// The kernel specialized for the body count of the current step or NULL if there is none. When
+// there is such a kernel it overrides active_method.
+PRIVATE AllPairsFixedKernel active_fixed = NULL;
+
+// Per-thread work areas for the mixed precision method and the capacity of each.
+PRIVATE MixedTile *mixed_tiles           = NULL;
+PRIVATE int        mixed_tile_count      = 0;
+PRIVATE int        mixed_row_capacity    = 0;
+PRIVATE int        mixed_column_capacity = 0;
+
+// The largest gravitational parameter in the store. The parameters are divided by this before
+// conversion to float.
+PRIVATE double mu_unit = 1.0;
+
+
+PUBLIC void AllPairs_initialize( void )
+{
+    selected_isa       = ALLPAIRS_SCALAR;
+    selected_forces    = AllPairs_forces_scalar;
+    selected_symmetric = AllPairs_symmetric_scalar;
+    selected_block     = AllPairs_block_scalar;
+    selected_mixed     = AllPairs_mixed_scalar;
+    selected_fixed     = AllPairs_fixed_scalar;
+    selected_ensemble  = AllPairs_ensemble_scalar;
+    selected_hermite   = AllPairs_hermite_scalar;
+
+    #if ALLPAIRS_X86
+    __builtin_cpu_init( );
+    if( __builtin_cpu_supports( "avx512f" ) ) {
+        selected_isa       = ALLPAIRS_AVX512;
+        selected_forces    = AllPairs_forces_avx512;
+        selected_symmetric = AllPairs_symmetric_avx512;
+        selected_block     = AllPairs_block_avx512;
+        selected_mixed     = AllPairs_mixed_avx512;
+        selected_fixed     = AllPairs_fixed_avx512;
+        selected_ensemble  = AllPairs_ensemble_avx512;
+        selected_hermite   = AllPairs_hermite_avx512;
+    }
+    else if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) {
+        selected_isa       = ALLPAIRS_AVX2;
+        selected_forces    = AllPairs_forces_avx2;
+        selected_symmetric = AllPairs_symmetric_avx2;
+        selected_block     = AllPairs_block_avx2;
+        selected_mixed     = AllPairs_mixed_avx2;
+        selected_fixed     = AllPairs_fixed_avx2;
+        selected_ensemble  = AllPairs_ensemble_avx2;
+        selected_hermite   = AllPairs_hermite_avx2;
+    }
+    #endif
+}
+
+
+PUBLIC enum AllPairsISA AllPairs_isa( void )
+{
+    return selected_isa;
+}
+
+
+PUBLIC const char *AllPairs_isa_name( void )
+{
+    switch( selected_isa ) {
+    case ALLPAIRS_AVX2:   return "AVX2";
+    case ALLPAIRS_AVX512: return "AVX-512";
+    default:              return "scalar";
+    }
+}
+
+
+PUBLIC void AllPairs_ensemble( Ensemble *ensemble )
+{
+    for( int group = 0; group < ensemble->group_count; ++group ) {
+        selected_ensemble( ensemble, group );
+    }
+}
+
+
+//! Divide 'count' rows evenly among the threads.
+PRIVATE void even_partition(
+    int count, int thread_id, int thread_count, int *start_index, int *stop_index )
+{
+    *start_index = (int)( (long long)count *   thread_id       / thread_count );
+    *stop_index  = (int)( (long long)count * ( thread_id + 1 ) / thread_count );
+}
+
+
+//! Divide 'count' rows of the upper triangle of the pair matrix evenly among the threads.
+/*!
+ * Row i contains the count - 1 - i pairs (i, j) with j > i, so equal numbers of rows would
+ * give the first thread far more work than the last. Instead the boundaries are placed where
+ * the number of pairs in the rows above them is a multiple of total_pairs / thread_count. The
+ * number of pairs in rows [0, r) is r * (2 * count - 1 - r) / 2; the boundaries are the roots
+ * of the resulting quadratic.
+ */
+PRIVATE int triangle_boundary( int count, int boundary, int thread_count )
+{
+    if( boundary <= 0 ) return 0;
+    if( boundary >= thread_count ) return count;
+
+    double n      = (double)count;
+    double target = ( n * ( n - 1.0 ) / 2.0 ) * boundary / thread_count;
+    double b      = 2.0 * n - 1.0;
+    int    row    = (int)( ( b - sqrt( b * b - 8.0 * target ) ) / 2.0 );
+
+    if( row < 0 ) row = 0;
+    if( row > count ) row = count;
+    return row;
+}
+
+
+//! Round 'value' up to a multiple of 'multiple'.
+PRIVATE int round_up( int value, int multiple )
+{
+    return ( ( value + multiple - 1 ) / multiple ) * multiple;
+}
+
+
+//! Compute the accelerations of bodies [start_row, stop_row) one tile at a time.
+/*!
+ * The rows are divided into tiles of options.tile_rows bodies and the columns into tiles of
+ * options.tile_columns bodies. All the column tiles are applied to one row tile before moving
+ * on to the next, so each column tile is read from memory once per row tile and then reused
+ * from cache by every block of rows in the tile. The row indices must be multiples of
+ * BODYSTORE_PADDING.
+ */
+PRIVATE void tiled_forces( BodyStore *bodies, int start_row, int stop_row )
+{
+    int tile_rows    = round_up( options.tile_rows, BODYSTORE_PADDING );
+    int tile_columns = options.tile_columns;
+
+    for( int i = start_row; i < stop_row; ++i ) {
+        bodies->ax[i] = bodies->ay[i] = bodies->az[i] = 0.0;
+    }
+
+    for( int row = start_row; row < stop_row; row += tile_rows ) {
+        int row_end = ( stop_row - row < tile_rows ) ? stop_row : row + tile_rows;
+
+        for( int column = 0; column < bodies->count; column += tile_columns ) {
+            int column_end = ( bodies->count - column < tile_columns ) ?
+                bodies->count : column + tile_columns;
+            selected_block( bodies, row, row_end, column, column_end );
+        }
+    }
+}
+
+
+//! Compute the accelerations and jerks of bodies [start_row, stop_row) one tile at a time.
+/*!
+ * The column tiles are options.tile_columns bodies wide. All of them are applied to a row
+ * tile of options.tile_rows bodies before moving on to the next, as in tiled_forces.
+ */
+PRIVATE void hermite_forces( BodyStore *bodies, int start_row, int stop_row )
+{
+    int tile_rows    = round_up( options.tile_rows, BODYSTORE_PADDING );
+    int tile_columns = options.tile_columns;
+
+    for( int i = start_row; i < stop_row; ++i ) {
+        bodies->ax[i] = bodies->ay[i] = bodies->az[i] = 0.0;
+        bodies->jx[i] = bodies->jy[i] = bodies->jz[i] = 0.0;
+    }
+
+    for( int row = start_row; row < stop_row; row += tile_rows ) {
+        int row_end = ( stop_row - row < tile_rows ) ? stop_row : row + tile_rows;
+
+        for( int column = 0; column < bodies->count; column += tile_columns ) {
+            int column_end = ( bodies->count - column < tile_columns ) ?
+                bodies->count : column + tile_columns;
+            selected_hermite( bodies, row, row_end, column, column_end );
+        }
+    }
+}
+
+
+PUBLIC void AllPairs_forces( BodyStore *bodies, int start_index, int stop_index )
+{
+    if( options.integrator == INTEGRATOR_HERMITE )
+        hermite_forces( bodies, start_index, stop_index );
+    else
+        selected_forces( bodies, start_index, stop_index );
+}
+
+//! Compute the accelerations of bodies [start_row, stop_row) with the mixed precision kernels.
+/*!
+ * The tiles are traversed as in tiled_forces. Each row tile gets its own origin, the centroid
+ * of the bodies in it, and the positions of the rows and of each column tile are converted to
+ * single precision relative to that origin. The kernels add the contributions of each small
+ * group of columns to double precision compensated sums, so the rounding error does not grow
+ * with the number of bodies.
+ */
+PRIVATE void mixed_tiled_forces(
+    BodyStore *bodies, MixedTile *tile, int start_row, int stop_row )
+{
+    int tile_rows    = round_up( options.tile_rows, BODYSTORE_PADDING );
+    int tile_columns = options.tile_columns;
+
+    for( int row = start_row; row < stop_row; row += tile_rows ) {
+        int    row_end  = ( stop_row - row < tile_rows ) ? stop_row : row + tile_rows;
+        int    real_end = ( row_end < bodies->count ) ? row_end : bodies->count;
+        double origin_x = 0.0, origin_y = 0.0, origin_z = 0.0;
+
+        for( int i = row; i < real_end; ++i ) {
+            origin_x += bodies->x[i];
+            origin_y += bodies->y[i];
+            origin_z += bodies->z[i];
+        }
+        if( real_end > row ) {
+            origin_x /= real_end - row;
+            origin_y /= real_end - row;
+            origin_z /= real_end - row;
+        }
+
+        // Extra rows needed to fill the last block are placed at the origin and ignored.
+        tile->row_count = round_up( row_end - row, ALLPAIRS_MIXED_ROWS );
+        for( int k = 0; k < tile->row_count; ++k ) {
+            int i = row + k;
+            tile->row_x[k] = ( i < row_end ) ? (float)( ( bodies->x[i] - origin_x ) / AU ) : 0;
+            tile->row_y[k] = ( i < row_end ) ? (float)( ( bodies->y[i] - origin_y ) / AU ) : 0;
+            tile->row_z[k] = ( i < row_end ) ? (float)( ( bodies->z[i] - origin_z ) / AU ) : 0;
+            for( int c = 0; c < 3; ++c ) {
+                tile->sum[c][k] = tile->compensation[c][k] = 0.0;
+            }
+        }
+
+        for( int column = 0; column < bodies->count; column += tile_columns ) {
+            int column_end = ( bodies->count - column < tile_columns ) ?
+                bodies->count : column + tile_columns;
+
+            tile->column_count = column_end - column;
+            for( int k = 0; k < tile->column_count; ++k ) {
+                int j = column + k;
+                tile->column_x[k]    = (float)( ( bodies->x[j] - origin_x ) / AU );
+                tile->column_y[k]    = (float)( ( bodies->y[j] - origin_y ) / AU );
+                tile->column_z[k]    = (float)( ( bodies->z[j] - origin_z ) / AU );
+                tile->column_mu[k]   = (float)( bodies->mu[j] / mu_unit );
+            }
+            selected_mixed( tile );
+        }
+
+        // Undo the scaling of the gravitational parameters and distances.
+        for( int i = row; i < row_end; ++i ) {
+            int    k      = i - row;
+            double factor = mu_unit / ( AU * AU );
+            bodies->ax[i] = factor * ( tile->sum[0][k] + tile->compensation[0][k] );
+            bodies->ay[i] = factor * ( tile->sum[1][k] + tile->compensation[1][k] );
+            bodies->az[i] = factor * ( tile->sum[2][k] + tile->compensation[2][k] );
+        }
+    }
+}
+
+
+//! Release the mixed precision work areas.
+PRIVATE void free_mixed_tiles( void )
+{
+    for( int i = 0; i < mixed_tile_count; ++i ) {
+        free( mixed_tiles[i].row_x );
+        free( mixed_tiles[i].sum[0] );
+    }
+    free( mixed_tiles );
+    mixed_tiles           = NULL;
+    mixed_tile_count      = 0;
+    mixed_row_capacity    = 0;
+    mixed_column_capacity = 0;
+}
+
+
+//! Make sure there is a mixed precision work area for each of 'thread_count' threads.
+/*!
+ * \return Zero if successful or -1 if the work areas could not be allocated.
+ */
+PRIVATE int reserve_mixed_tiles( int thread_count )
+{
+    int rows    = round_up( options.tile_rows, BODYSTORE_PADDING );
+    int columns = options.tile_columns;
+
+    rows = round_up( rows, ALLPAIRS_MIXED_ROWS );
+
+    if( thread_count <= mixed_tile_count &&
+        rows <= mixed_row_capacity && columns <= mixed_column_capacity ) return 0;
+
+    free_mixed_tiles( );
+    if( ( mixed_tiles = (MixedTile *)calloc( thread_count, sizeof(MixedTile) ) ) == NULL )
+        return -1;
+    mixed_tile_count      = thread_count;
+    mixed_row_capacity    = rows;
+    mixed_column_capacity = columns;
+
+    for( int i = 0; i < thread_count; ++i ) {
+        MixedTile *tile    = &mixed_tiles[i];
+        float     *floats  = (float *)malloc( ( 3 * rows + 4 * columns ) * sizeof(float) );
+        double    *doubles = (double *)malloc( 6 * rows * sizeof(double) );
+
+        // Both blocks are recorded before checking so that free_mixed_tiles releases them.
+        tile->row_x  = floats;
+        tile->sum[0] = doubles;
+        if( floats == NULL || doubles == NULL ) {
+            free_mixed_tiles( );
+            return -1;
+        }
+        tile->row_y       = tile->row_x    + rows;
+        tile->row_z       = tile->row_y    + rows;
+        tile->column_x    = tile->row_z    + rows;
+        tile->column_y    = tile->column_x + columns;
+        tile->column_z    = tile->column_y + columns;
+        tile->column_mu = tile->column_z + columns;
+        for( int c = 0; c < 3; ++c ) {
+            tile->sum[c]          = doubles + c * rows;
+            tile->compensation[c] = doubles + ( 3 + c ) * rows;
+        }
+    }
+    return 0;
+}
+
+
+PUBLIC int AllPairs_prepare( BodyStore *bodies, int thread_count )
+{
+    active_method =
+        ( options.precision == PRECISION_MIXED ) ? FORCE_TILED : options.force_method;
+
+    // Only the double precision tiled kernels compute the jerks. They replace every method.
+    active_jerk = ( options.integrator == INTEGRATOR_HERMITE );
+    if( active_jerk ) {
+        active_fixed = NULL;
+        bodies->thread_count = thread_count;
+        return 0;
+    }
+
+    // The fixed count kernels compute exactly in double precision.
+    active_fixed = NULL;
+    if( options.fixed_kernels && options.precision == PRECISION_DOUBLE &&
+        options.rsqrt_iterations == 0 && bodies->count <= ALLPAIRS_FIXED_MAX ) {
+        active_fixed = selected_fixed[bodies->count];
+    }
+
+    if( options.precision == PRECISION_MIXED ) {
+        if( reserve_mixed_tiles( thread_count ) != 0 ) return -1;
+        mu_unit = 0.0;
+        for( int i = 0; i < bodies->count; ++i ) {
+            if( bodies->mu[i] > mu_unit ) mu_unit = bodies->mu[i];
+        }
+        if( mu_unit == 0.0 ) mu_unit = 1.0;
+    }
+    if( active_fixed == NULL && active_method == FORCE_SYMMETRIC ) {
+        // Thread zero accumulates directly into the store's acceleration arrays.
+        if( BodyStore_reserve( bodies, thread_count - 1 ) != 0 ) return -1;
+    }
+    bodies->thread_count = thread_count;
+    return 0;
+}
+
+
+PUBLIC void AllPairs_compute( BodyStore *bodies, int thread_id )
+{
+    int thread_count = bodies->thread_count;
+    int start_index;
+    int stop_index;
+
+    if( active_jerk ) {
+        int block_count = bodies->padded_count / BODYSTORE_PADDING;
+        even_partition( block_count, thread_id, thread_count, &start_index, &stop_index );
+        start_index *= BODYSTORE_PADDING;
+        stop_index  *= BODYSTORE_PADDING;
+        hermite_forces( bodies, start_index, stop_index );
+        return;
+    }
+
+    // There are too few pairs to be worth dividing. Thread zero does them all.
+    if( active_fixed != NULL ) {
+        if( thread_id == 0 ) active_fixed( bodies );
+        return;
+    }
+
+    if( active_method == FORCE_DIRECT ) {
+        even_partition( bodies->count, thread_id, thread_count, &start_index, &stop_index );
+        selected_forces( bodies, start_index, stop_index );
+        return;
+    }
+
+    // The tiled kernels work on whole blocks of rows. The padding rows receive no force.
+    if( active_method == FORCE_TILED ) {
+        int block_count = bodies->padded_count / BODYSTORE_PADDING;
+        even_partition( block_count, thread_id, thread_count, &start_index, &stop_index );
+        start_index *= BODYSTORE_PADDING;
+        stop_index  *= BODYSTORE_PADDING;
+        if( options.precision == PRECISION_MIXED )
+            mixed_tiled_forces( bodies, &mixed_tiles[thread_id], start_index, stop_index );
+        else
+            tiled_forces( bodies, start_index, stop_index );
+        return;
+    }
+
+    double *ax = BodyStore_accumulator( bodies, thread_id, 0 );
+    double *ay = BodyStore_accumulator( bodies, thread_id, 1 );
+    double *az = BodyStore_accumulator( bodies, thread_id, 2 );
+
+    // Each thread clears its own arrays. The rows of other threads add to every column.
+    for( int i = 0; i < bodies->padded_count; ++i ) {
+        ax[i] = ay[i] = az[i] = 0.0;
+    }
+    start_index = triangle_boundary( bodies->count, thread_id, thread_count );
+    stop_index  = triangle_boundary( bodies->count, thread_id + 1, thread_count );
+    selected_symmetric( bodies, start_index, stop_index, ax, ay, az );
+}
+
+
+PUBLIC void AllPairs_finish( BodyStore *bodies, int start_index, int stop_index )
+{
+    if( active_jerk || active_fixed != NULL || active_method != FORCE_SYMMETRIC ) return;
+
+    // Thread zero's contributions are already in place. Add everyone else's.
+    for( int thread_id = 1; thread_id < bodies->thread_count; ++thread_id ) {
+        const double *ax = BodyStore_accumulator( bodies, thread_id, 0 );
+        const double *ay = BodyStore_accumulator( bodies, thread_id, 1 );
+        const double *az = BodyStore_accumulator( bodies, thread_id, 2 );
+
+        for( int i = start_index; i < stop_index; ++i ) {
+            bodies->ax[i] += ax[i];
+            bodies->ay[i] += ay[i];
+            bodies->az[i] += az[i];
+        }
+    }
+}
+
+
+
+PUBLIC double AllPairs_mixed_precision_error( BodyStore *bodies )
+{
+    enum Precision saved_precision = options.precision;
+    double        *mixed_result    = (double *)malloc( 3 * bodies->count * sizeof(double) );
+    double         maximum_error   = 0.0;
+
+    if( mixed_result == NULL ) return -1.0;
+    options.precision = PRECISION_MIXED;
+    if( AllPairs_prepare( bodies, 1 ) != 0 ) {
+        options.precision = saved_precision;
+        free( mixed_result );
+        return -1.0;
+    }
+    AllPairs_compute( bodies, 0 );
+    AllPairs_finish( bodies, 0, bodies->count );
+    options.precision = saved_precision;
+
+    for( int i = 0; i < bodies->count; ++i ) {
+        mixed_result[3 * i + 0] = bodies->ax[i];
+        mixed_result[3 * i + 1] = bodies->ay[i];
+        mixed_result[3 * i + 2] = bodies->az[i];
+    }
+
+    // The direct kernel in double precision is the reference.
+    selected_forces( bodies, 0, bodies->count );
+    for( int i = 0; i < bodies->count; ++i ) {
+        double dx = mixed_result[3 * i + 0] - bodies->ax[i];
+        double dy = mixed_result[3 * i + 1] - bodies->ay[i];
+        double dz = mixed_result[3 * i + 2] - bodies->az[i];
+        double magnitude = sqrt( bodies->ax[i] * bodies->ax[i] +
+                                 bodies->ay[i] * bodies->ay[i] +
+                                 bodies->az[i] * bodies->az[i] );
+        if( magnitude > 0.0 ) {
+            double error = sqrt( dx * dx + dy * dy + dz * dz ) / magnitude;
+            if( error > maximum_error ) maximum_error = error;
+        }
+    }
+    free( mixed_result );
+    return maximum_error;
+}
+
+
+// The portable direct kernel. The inner loop has no branches and no function calls so the
+// compiler can vectorize it using whatever instructions the library is compiled for.
+//
+PUBLIC void AllPairs_forces_scalar( BodyStore *bodies, int start_index, int stop_index )
+{
+    const double *restrict x    = bodies->x;
+    const double *restrict y    = bodies->y;
+    const double *restrict z    = bodies->z;
+    const double *restrict mu   = bodies->mu;
+
+    // For each object...
+    for( int object_i = start_index; object_i < stop_index; ++object_i ) {
+        double ax = 0.0;
+        double ay = 0.0;
+        double az = 0.0;
+
+        // Consider interactions with all other objects...
+        for( int object_j = 0; object_j < bodies->padded_count; ++object_j ) {
+            double dx = x[object_j] - x[object_i];
+            double dy = y[object_j] - y[object_i];
+            double dz = z[object_j] - z[object_i];
+            double distance_squared = dx * dx + dy * dy + dz * dz;
+
+            // The acceleration of object_i due to object_j is mu_j * displacement / distance^3.
+            // The self interaction (zero distance) is masked out instead of being skipped with
+            // a branch.
+            double scale = ( distance_squared > 0.0 ) ?
+                mu[object_j] / ( distance_squared * sqrt( distance_squared ) ) : 0.0;
+            ax += scale * dx;
+            ay += scale * dy;
+            az += scale * dz;
+        }
+
+        bodies->ax[object_i] = ax;
+        bodies->ay[object_i] = ay;
+        bodies->az[object_i] = az;
+    }
+}
+
+
+// The portable symmetric kernel. As with the direct kernel the inner loop is written so that
+// the compiler can vectorize it. There are no dependencies between iterations because each
+// iteration updates a different column.
+//
+PUBLIC void AllPairs_symmetric_scalar(
+    const BodyStore *bodies, int start_row, int stop_row, double *ax, double *ay, double *az )
+{
+    const double *restrict x    = bodies->x;
+    const double *restrict y    = bodies->y;
+    const double *restrict z    = bodies->z;
+    const double *restrict mu   = bodies->mu;
+    double *restrict column_ax  = ax;
+    double *restrict column_ay  = ay;
+    double *restrict column_az  = az;
+
+    for( int object_i = start_row; object_i < stop_row; ++object_i ) {
+        double mu_i   = mu[object_i];
+        double row_ax = 0.0;
+        double row_ay = 0.0;
+        double row_az = 0.0;
+
+        for( int object_j = object_i + 1; object_j < bodies->count; ++object_j ) {
+            double dx = x[object_j] - x[object_i];
+            double dy = y[object_j] - y[object_i];
+            double dz = z[object_j] - z[object_i];
+            double distance_squared = dx * dx + dy * dy + dz * dz;
+            double scale = ( distance_squared > 0.0 ) ?
+                1.0 / ( distance_squared * sqrt( distance_squared ) ) : 0.0;
+
+            // Newton's third law: object_j feels the same force in the opposite direction, so
+            // its acceleration uses mu_i where the acceleration of object_i uses mu_j.
+            row_ax += mu[object_j] * scale * dx;
+            row_ay += mu[object_j] * scale * dy;
+            row_az += mu[object_j] * scale * dz;
+            column_ax[object_j] -= mu_i * scale * dx;
+            column_ay[object_j] -= mu_i * scale * dy;
+            column_az[object_j] -= mu_i * scale * dz;
+        }
+        column_ax[object_i] += row_ax;
+        column_ay[object_i] += row_ay;
+        column_az[object_i] += row_az;
+    }
+}
+
+
+// The portable block kernel. The rows are processed BODYSTORE_PADDING at a time. The loop over
+// the rows of a block has a fixed trip count and independent iterations so the compiler can
+// turn it into vector instructions with the accumulators held in registers.
+//
+PUBLIC void AllPairs_block_scalar(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column )
+{
+    const double *restrict x    = bodies->x;
+    const double *restrict y    = bodies->y;
+    const double *restrict z    = bodies->z;
+    const double *restrict mu   = bodies->mu;
+
+    for( int block = start_row; block < stop_row; block += BODYSTORE_PADDING ) {
+        double ax[BODYSTORE_PADDING] = { 0.0 };
+        double ay[BODYSTORE_PADDING] = { 0.0 };
+        double az[BODYSTORE_PADDING] = { 0.0 };
+
+        for( int object_j = start_column; object_j < stop_column; ++object_j ) {
+            for( int k = 0; k < BODYSTORE_PADDING; ++k ) {
+                double dx = x[object_j] - x[block + k];
+                double dy = y[object_j] - y[block + k];
+                double dz = z[object_j] - z[block + k];
+                double distance_squared = dx * dx + dy * dy + dz * dz;
+                double scale = ( distance_squared > 0.0 ) ?
+                    mu[object_j] / ( distance_squared * sqrt( distance_squared ) ) : 0.0;
+                ax[k] += scale * dx;
+                ay[k] += scale * dy;
+                az[k] += scale * dz;
+            }
+        }
+
+        for( int k = 0; k < BODYSTORE_PADDING; ++k ) {
+            bodies->ax[block + k] += ax[k];
+            bodies->ay[block + k] += ay[k];
+            bodies->az[block + k] += az[k];
+        }
+    }
+}
+
+
+PUBLIC void AllPairs_mixed_scalar( MixedTile *tile )
+{
+    AllPairs_mixed_generic( tile );
+}
+
+
+PUBLIC void AllPairs_ensemble_scalar( Ensemble *ensemble, int group )
+{
+    AllPairs_ensemble_generic( ensemble, group );
+}
+
+
+PUBLIC void AllPairs_hermite_scalar(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column )
+{
+    AllPairs_hermite_generic( bodies, start_row, stop_row, start_column, stop_column );
+}
+
+
+// The fixed count kernels (see AllPairsKernels.h) compiled for the library's instruction set.
+ALLPAIRS_FIXED_TABLE( AllPairs_fixed_scalar, )
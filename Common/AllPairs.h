@@ -0,0 +1,149 @@
+/*! \file    AllPairs.h
+ *  \brief   Interface to the all-pairs gravitational force kernels.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The kernels declared here compute the gravitational acceleration of a range of bodies due to
+ * all the other bodies in a BodyStore. They are shared by all the all-pairs programs (Serial,
+ * OpenMP, the POSIX thread versions, and MPI) so that improvements to the inner loop benefit
+ * every version at once.
+ *
+ * Several implementations of each kernel exist, each targeting a different instruction set. The
+ * best one supported by the processor the program is running on is selected at run time. The
+ * program does not need to be compiled for a particular processor.
+ *
+ * Multithreaded programs compute the accelerations of all bodies in two phases:
+ *
+ * 1. One thread calls AllPairs_prepare with the number of threads that will participate.
+ * 2. Every thread calls AllPairs_compute with its own thread ID.
+ * 3. After all threads have finished step 2 (a barrier), the threads call AllPairs_finish on
+ *    disjoint ranges that together cover all the bodies.
+ *
+ * The method used (see options.force_method) is hidden behind these functions. With the direct
+ * method each thread computes the total acceleration of a block of bodies in step 2 and step 3
+ * does nothing. With the symmetric method each pair of bodies is visited only once and the
+ * accelerations of both are updated from the same 1 / r^3, scaled by the other body's
+ * gravitational parameter. Each thread accumulates into private arrays, so no
+ * locks or atomic operations are needed, and step 3 sums the private arrays. The pairs are
+ * divided so that each thread handles the same number of them.
+ *
+ * The tiled method computes the same sums as the direct method but in tiles (see
+ * options.tile_rows and options.tile_columns) so that the attracting bodies are read from
+ * memory once per tile of attracted bodies rather than once per body. The kernels also
+ * update several bodies for each body read (register blocking). For large numbers of bodies
+ * the direct method is limited by memory traffic rather than arithmetic.
+ *
+ * When options.precision is PRECISION_MIXED the tiled method is used whatever the value of
+ * options.force_method. The separation and inverse distance of each pair are then computed in
+ * single precision, relative to an origin chosen for each tile, and the results are summed in
+ * double precision using compensated summation. Positions and velocities remain in double
+ * precision. AllPairs_mixed_precision_error measures the resulting loss of accuracy.
+ *
+ * When the store holds no more than ALLPAIRS_FIXED_MAX bodies (see AllPairsKernels.h) and
+ * options.fixed_kernels is set, AllPairs_compute uses a kernel specialized for that exact body
+ * count instead of the chosen method. Its loops over the pairs are unrolled completely, which
+ * removes the loop and partitioning overhead that dominates the cost of small systems. The
+ * first thread does all the work. These kernels are only used for exact double precision
+ * computations and they assume that no two bodies occupy the same position.
+ *
+ * When options.rsqrt_iterations is greater than zero the AVX2 and AVX-512 kernels compute the
+ * inverse cube of each distance from the processor's approximate reciprocal square root
+ * instruction refined by that many Newton-Raphson steps instead of using a square root and a
+ * division. With AVX-512 two steps give full double precision; AVX2 needs three. The portable
+ * kernels have no such instruction and always compute exactly.
+ *
+ * When options.integrator is INTEGRATOR_HERMITE the time derivatives of the accelerations
+ * (the jerks) are computed as well and written to the jx, jy, and jz arrays of the store.
+ * They depend on the relative velocities, which the store also holds. The jerks are computed
+ * by tiled double precision kernels whatever the values of options.force_method,
+ * options.precision, options.rsqrt_iterations, and options.fixed_kernels.
+ */
+
+#ifndef ALLPAIRS_H
+#define ALLPAIRS_H
+
+#include "BodyStore.h"
+#include "Ensemble.h"
+#include "Options.h"
+
+//! The instruction sets for which kernels exist.
+enum AllPairsISA {
+    ALLPAIRS_SCALAR,    //!< Portable C. Used on processors without a more specific kernel.
+    ALLPAIRS_AVX2,      //!< 256 bit vectors (four doubles) with fused multiply-add.
+    ALLPAIRS_AVX512     //!< 512 bit vectors (eight doubles).
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Select the kernels to use based on the features of the processor.
+/*!
+ * This function must be called before any kernel is used. It is called by
+ * initialize_object_arrays so programs using that function need not call it themselves. It is
+ * not safe to call this function while kernels are executing in other threads.
+ */
+void AllPairs_initialize( void );
+
+//! Return the instruction set of the selected kernels.
+enum AllPairsISA AllPairs_isa( void );
+
+//! Return a human readable name for the instruction set of the selected kernels.
+const char *AllPairs_isa_name( void );
+
+//! Compute the acceleration of bodies [start_index, stop_index) due to all bodies in the store.
+/*!
+ * The results are written to the ax, ay, and az arrays of the store. Only the elements in the
+ * given range are modified so different threads can safely process disjoint ranges of the same
+ * store at the same time.
+ *
+ * Pairs of bodies that occupy exactly the same position are ignored. This includes each body's
+ * interaction with itself.
+ */
+void AllPairs_forces( BodyStore *bodies, int start_index, int stop_index );
+
+//! Prepare to compute the accelerations of all bodies with 'thread_count' threads.
+/*!
+ * This function must be called by one thread before any thread calls AllPairs_compute.
+ *
+ * \return Zero if successful or -1 if the per-thread arrays could not be allocated.
+ */
+int AllPairs_prepare( BodyStore *bodies, int thread_count );
+
+//! Do the share of the computation belonging to thread 'thread_id'.
+/*!
+ * Thread IDs range from zero to one less than the thread count given to AllPairs_prepare.
+ * Every thread ID must be used exactly once.
+ */
+void AllPairs_compute( BodyStore *bodies, int thread_id );
+
+//! Complete the accelerations of bodies [start_index, stop_index).
+/*!
+ * This function must not be called until every thread has returned from AllPairs_compute. When
+ * it returns, the accelerations of bodies in the range are in the ax, ay, and az arrays.
+ */
+void AllPairs_finish( BodyStore *bodies, int start_index, int stop_index );
+
+//! Compute the accelerations of all bodies in every simulation of the ensemble.
+/*!
+ * The results are written to the ax, ay, and az arrays of the ensemble. Each simulation is
+ * computed in its own vector lane (see Ensemble.h). Bodies of the same simulation must not
+ * occupy the same position.
+ */
+void AllPairs_ensemble( Ensemble *ensemble );
+
+//! Compare mixed precision accelerations with double precision ones for the current positions.
+/*!
+ * Both sets are computed by the calling thread. When this function returns the store holds the
+ * double precision accelerations. AllPairs_prepare must be called again before the next use
+ * of AllPairs_compute.
+ *
+ * \return The largest relative error in the magnitude of the difference between the results for
+ * any body, or a negative value if memory could not be allocated.
+ */
+double AllPairs_mixed_precision_error( BodyStore *bodies );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
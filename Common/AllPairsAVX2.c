@@ -0,0 +1,245 @@
+/*! \file    AllPairsAVX2.c
+ *  \brief   Implementation of the all-pairs kernels using AVX2 and FMA instructions.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The functions in this file are compiled for AVX2 using the target attribute. They must only
+ * be called after AllPairs_initialize has confirmed that the processor supports AVX2 and FMA.
+ */
+
+#include "AllPairsKernels.h"
+
+#if ALLPAIRS_X86
+
+#include <immintrin.h>
+
+#define AVX2 __attribute__(( target( "avx2,fma" ) ))
+
+//! Return numerator / distance^3. Lanes where the distance is zero are not meaningful.
+/*!
+ * If 'iterations' is zero the result is computed with a square root and a division. Otherwise
+ * the 12 bit single precision estimate of 1 / distance given by vrsqrtps is refined with the
+ * given number of Newton-Raphson steps in double precision and cubed.
+ */
+AVX2 static inline __m256d interaction_scale(
+    __m256d numerator, __m256d distance_squared, int iterations )
+{
+    if( iterations == 0 ) {
+        __m256d distance_cubed =
+            _mm256_mul_pd( distance_squared, _mm256_sqrt_pd( distance_squared ) );
+        return _mm256_div_pd( numerator, distance_cubed );
+    }
+
+    __m256d inverse = _mm256_cvtps_pd( _mm_rsqrt_ps( _mm256_cvtpd_ps( distance_squared ) ) );
+    __m256d half_d2 = _mm256_mul_pd( _mm256_set1_pd( 0.5 ), distance_squared );
+    for( int i = 0; i < iterations; ++i ) {
+        __m256d inverse_squared = _mm256_mul_pd( inverse, inverse );
+        inverse = _mm256_mul_pd(
+            inverse, _mm256_fnmadd_pd( half_d2, inverse_squared, _mm256_set1_pd( 1.5 ) ) );
+    }
+    __m256d inverse_cubed = _mm256_mul_pd( _mm256_mul_pd( inverse, inverse ), inverse );
+    return _mm256_mul_pd( numerator, inverse_cubed );
+}
+
+
+//! Add the four lanes of a vector.
+AVX2 static inline double horizontal_sum( __m256d v )
+{
+    __m128d low  = _mm256_castpd256_pd128( v );
+    __m128d high = _mm256_extractf128_pd( v, 1 );
+    low = _mm_add_pd( low, high );
+    return _mm_cvtsd_f64( _mm_add_sd( low, _mm_unpackhi_pd( low, low ) ) );
+}
+
+
+AVX2 void AllPairs_forces_avx2( BodyStore *bodies, int start_index, int stop_index )
+{
+    const __m256d zero       = _mm256_setzero_pd( );
+    const int     iterations = options.rsqrt_iterations;
+
+    for( int object_i = start_index; object_i < stop_index; ++object_i ) {
+        __m256d xi = _mm256_set1_pd( bodies->x[object_i] );
+        __m256d yi = _mm256_set1_pd( bodies->y[object_i] );
+        __m256d zi = _mm256_set1_pd( bodies->z[object_i] );
+        __m256d ax = zero;
+        __m256d ay = zero;
+        __m256d az = zero;
+
+        // The arrays are aligned and padded so there is no need for a scalar tail loop.
+        for( int object_j = 0; object_j < bodies->padded_count; object_j += 4 ) {
+            __m256d dx = _mm256_sub_pd( _mm256_load_pd( &bodies->x[object_j] ), xi );
+            __m256d dy = _mm256_sub_pd( _mm256_load_pd( &bodies->y[object_j] ), yi );
+            __m256d dz = _mm256_sub_pd( _mm256_load_pd( &bodies->z[object_j] ), zi );
+            __m256d distance_squared =
+                _mm256_fmadd_pd( dx, dx, _mm256_fmadd_pd( dy, dy, _mm256_mul_pd( dz, dz ) ) );
+
+            // The self interaction divides by zero. Its (infinite) contribution is masked off.
+            __m256d scale = interaction_scale(
+                _mm256_load_pd( &bodies->mu[object_j] ), distance_squared, iterations );
+            scale = _mm256_and_pd(
+                scale, _mm256_cmp_pd( distance_squared, zero, _CMP_GT_OQ ) );
+
+            ax = _mm256_fmadd_pd( scale, dx, ax );
+            ay = _mm256_fmadd_pd( scale, dy, ay );
+            az = _mm256_fmadd_pd( scale, dz, az );
+        }
+
+        bodies->ax[object_i] = horizontal_sum( ax );
+        bodies->ay[object_i] = horizontal_sum( ay );
+        bodies->az[object_i] = horizontal_sum( az );
+    }
+}
+
+
+AVX2 void AllPairs_symmetric_avx2(
+    const BodyStore *bodies, int start_row, int stop_row, double *ax, double *ay, double *az )
+{
+    const __m256d zero       = _mm256_setzero_pd( );
+    const __m256d one        = _mm256_set1_pd( 1.0 );
+    const int     iterations = options.rsqrt_iterations;
+
+    for( int object_i = start_row; object_i < stop_row; ++object_i ) {
+        double mu_i              = bodies->mu[object_i];
+        double acceleration_i[3] = { 0.0, 0.0, 0.0 };
+        int    object_j          = object_i + 1;
+        int    aligned_j         = ( object_j + 3 ) & ~3;
+
+        // Handle single columns until the column index is a multiple of the vector width.
+        // Columns past the last body are padding and can be skipped.
+        for( ; object_j < aligned_j; ++object_j ) {
+            if( object_j < bodies->count )
+                AllPairs_symmetric_pair(
+                    bodies, object_i, object_j, mu_i, acceleration_i, ax, ay, az );
+        }
+
+        __m256d xi     = _mm256_set1_pd( bodies->x[object_i] );
+        __m256d yi     = _mm256_set1_pd( bodies->y[object_i] );
+        __m256d zi     = _mm256_set1_pd( bodies->z[object_i] );
+        __m256d mui    = _mm256_set1_pd( mu_i );
+        __m256d row_ax = zero;
+        __m256d row_ay = zero;
+        __m256d row_az = zero;
+
+        // The padding bodies have no mass so the accelerations they receive are harmless.
+        for( ; object_j < bodies->padded_count; object_j += 4 ) {
+            __m256d dx = _mm256_sub_pd( _mm256_load_pd( &bodies->x[object_j] ), xi );
+            __m256d dy = _mm256_sub_pd( _mm256_load_pd( &bodies->y[object_j] ), yi );
+            __m256d dz = _mm256_sub_pd( _mm256_load_pd( &bodies->z[object_j] ), zi );
+            __m256d distance_squared =
+                _mm256_fmadd_pd( dx, dx, _mm256_fmadd_pd( dy, dy, _mm256_mul_pd( dz, dz ) ) );
+            __m256d inverse_cubed = _mm256_and_pd(
+                interaction_scale( one, distance_squared, iterations ),
+                _mm256_cmp_pd( distance_squared, zero, _CMP_GT_OQ ) );
+
+            // Each body's acceleration is due to the other body's gravitational parameter.
+            __m256d row_scale    =
+                _mm256_mul_pd( inverse_cubed, _mm256_load_pd( &bodies->mu[object_j] ) );
+            __m256d column_scale = _mm256_mul_pd( inverse_cubed, mui );
+
+            row_ax = _mm256_fmadd_pd( row_scale, dx, row_ax );
+            row_ay = _mm256_fmadd_pd( row_scale, dy, row_ay );
+            row_az = _mm256_fmadd_pd( row_scale, dz, row_az );
+            _mm256_store_pd( &ax[object_j],
+                _mm256_fnmadd_pd( column_scale, dx, _mm256_load_pd( &ax[object_j] ) ) );
+            _mm256_store_pd( &ay[object_j],
+                _mm256_fnmadd_pd( column_scale, dy, _mm256_load_pd( &ay[object_j] ) ) );
+            _mm256_store_pd( &az[object_j],
+                _mm256_fnmadd_pd( column_scale, dz, _mm256_load_pd( &az[object_j] ) ) );
+        }
+
+        ax[object_i] += acceleration_i[0] + horizontal_sum( row_ax );
+        ay[object_i] += acceleration_i[1] + horizontal_sum( row_ay );
+        az[object_i] += acceleration_i[2] + horizontal_sum( row_az );
+    }
+}
+
+//! Add the acceleration due to one body (broadcast in xj, yj, zj, muj) on four bodies.
+AVX2 static inline void block_interaction(
+    __m256d xi, __m256d yi, __m256d zi, __m256d xj, __m256d yj, __m256d zj, __m256d muj,
+    int iterations, __m256d *ax, __m256d *ay, __m256d *az )
+{
+    __m256d dx = _mm256_sub_pd( xj, xi );
+    __m256d dy = _mm256_sub_pd( yj, yi );
+    __m256d dz = _mm256_sub_pd( zj, zi );
+    __m256d distance_squared =
+        _mm256_fmadd_pd( dx, dx, _mm256_fmadd_pd( dy, dy, _mm256_mul_pd( dz, dz ) ) );
+    __m256d scale = _mm256_and_pd( interaction_scale( muj, distance_squared, iterations ),
+        _mm256_cmp_pd( distance_squared, _mm256_setzero_pd( ), _CMP_GT_OQ ) );
+
+    *ax = _mm256_fmadd_pd( scale, dx, *ax );
+    *ay = _mm256_fmadd_pd( scale, dy, *ay );
+    *az = _mm256_fmadd_pd( scale, dz, *az );
+}
+
+
+//! Add the accumulated accelerations in ax, ay, and az to the store's arrays at 'index'.
+AVX2 static inline void block_store(
+    BodyStore *bodies, int index, __m256d ax, __m256d ay, __m256d az )
+{
+    _mm256_store_pd( &bodies->ax[index],
+        _mm256_add_pd( _mm256_load_pd( &bodies->ax[index] ), ax ) );
+    _mm256_store_pd( &bodies->ay[index],
+        _mm256_add_pd( _mm256_load_pd( &bodies->ay[index] ), ay ) );
+    _mm256_store_pd( &bodies->az[index],
+        _mm256_add_pd( _mm256_load_pd( &bodies->az[index] ), az ) );
+}
+
+
+// The rows are held in two vectors (eight bodies) so each column is loaded and broadcast once
+// for eight interactions. The accumulators and row positions use 12 of the 16 registers.
+//
+AVX2 void AllPairs_block_avx2(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column )
+{
+    const int iterations = options.rsqrt_iterations;
+
+    for( int block = start_row; block < stop_row; block += 8 ) {
+        __m256d xi0 = _mm256_load_pd( &bodies->x[block] );
+        __m256d yi0 = _mm256_load_pd( &bodies->y[block] );
+        __m256d zi0 = _mm256_load_pd( &bodies->z[block] );
+        __m256d xi1 = _mm256_load_pd( &bodies->x[block + 4] );
+        __m256d yi1 = _mm256_load_pd( &bodies->y[block + 4] );
+        __m256d zi1 = _mm256_load_pd( &bodies->z[block + 4] );
+        __m256d ax0 = _mm256_setzero_pd( ), ay0 = ax0, az0 = ax0;
+        __m256d ax1 = ax0, ay1 = ax0, az1 = ax0;
+
+        for( int object_j = start_column; object_j < stop_column; ++object_j ) {
+            __m256d xj = _mm256_broadcast_sd( &bodies->x[object_j] );
+            __m256d yj = _mm256_broadcast_sd( &bodies->y[object_j] );
+            __m256d zj = _mm256_broadcast_sd( &bodies->z[object_j] );
+            __m256d muj = _mm256_broadcast_sd( &bodies->mu[object_j] );
+
+            block_interaction( xi0, yi0, zi0, xj, yj, zj, muj, iterations, &ax0, &ay0, &az0 );
+            block_interaction( xi1, yi1, zi1, xj, yj, zj, muj, iterations, &ax1, &ay1, &az1 );
+        }
+        block_store( bodies, block,     ax0, ay0, az0 );
+        block_store( bodies, block + 4, ax1, ay1, az1 );
+    }
+}
+
+
+// The generic kernel is inlined here so that it is vectorized for this instruction set.
+AVX2 void AllPairs_mixed_avx2( MixedTile *tile )
+{
+    AllPairs_mixed_generic( tile );
+}
+
+
+// One simulation per lane. AVX2 processes a group of simulations with two vectors.
+AVX2 void AllPairs_ensemble_avx2( Ensemble *ensemble, int group )
+{
+    AllPairs_ensemble_generic( ensemble, group );
+}
+
+
+// A block of rows fills two vectors.
+AVX2 void AllPairs_hermite_avx2(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column )
+{
+    AllPairs_hermite_generic( bodies, start_row, stop_row, start_column, stop_column );
+}
+
+
+// The fixed count kernels (see AllPairsKernels.h) compiled for this instruction set.
+ALLPAIRS_FIXED_TABLE( AllPairs_fixed_avx2, AVX2 )
+
+#endif
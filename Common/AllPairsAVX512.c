@@ -0,0 +1,249 @@
+/*! \file    AllPairsAVX512.c
+ *  \brief   Implementation of the all-pairs kernels using AVX-512 instructions.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The functions in this file are compiled for AVX-512 using the target attribute. They must
+ * only be called after AllPairs_initialize has confirmed that the processor supports AVX-512.
+ */
+
+#include "AllPairsKernels.h"
+
+#if ALLPAIRS_X86
+
+#include <immintrin.h>
+
+#define AVX512 __attribute__(( target( "avx512f" ) ))
+
+//! Return numerator / distance^3 in the lanes selected by 'nonzero' and zero elsewhere.
+/*!
+ * If 'iterations' is zero the result is computed with a square root and a division. Otherwise
+ * the 14 bit estimate of 1 / distance given by vrsqrt14pd is refined with the given number of
+ * Newton-Raphson steps (each roughly doubles the number of correct bits) and cubed.
+ */
+AVX512 static inline __m512d interaction_scale(
+    __m512d numerator, __m512d distance_squared, __mmask8 nonzero, int iterations )
+{
+    if( iterations == 0 ) {
+        __m512d distance_cubed =
+            _mm512_mul_pd( distance_squared, _mm512_sqrt_pd( distance_squared ) );
+        return _mm512_maskz_div_pd( nonzero, numerator, distance_cubed );
+    }
+
+    __m512d inverse = _mm512_rsqrt14_pd( distance_squared );
+    __m512d half_d2 = _mm512_mul_pd( _mm512_set1_pd( 0.5 ), distance_squared );
+    for( int i = 0; i < iterations; ++i ) {
+        __m512d inverse_squared = _mm512_mul_pd( inverse, inverse );
+        inverse = _mm512_mul_pd(
+            inverse, _mm512_fnmadd_pd( half_d2, inverse_squared, _mm512_set1_pd( 1.5 ) ) );
+    }
+    __m512d inverse_cubed = _mm512_mul_pd( _mm512_mul_pd( inverse, inverse ), inverse );
+    return _mm512_maskz_mul_pd( nonzero, numerator, inverse_cubed );
+}
+
+AVX512 void AllPairs_forces_avx512( BodyStore *bodies, int start_index, int stop_index )
+{
+    const __m512d zero       = _mm512_setzero_pd( );
+    const int     iterations = options.rsqrt_iterations;
+
+    for( int object_i = start_index; object_i < stop_index; ++object_i ) {
+        __m512d xi = _mm512_set1_pd( bodies->x[object_i] );
+        __m512d yi = _mm512_set1_pd( bodies->y[object_i] );
+        __m512d zi = _mm512_set1_pd( bodies->z[object_i] );
+        __m512d ax = zero;
+        __m512d ay = zero;
+        __m512d az = zero;
+
+        // The arrays are aligned and padded so there is no need for a scalar tail loop.
+        for( int object_j = 0; object_j < bodies->padded_count; object_j += 8 ) {
+            __m512d dx = _mm512_sub_pd( _mm512_load_pd( &bodies->x[object_j] ), xi );
+            __m512d dy = _mm512_sub_pd( _mm512_load_pd( &bodies->y[object_j] ), yi );
+            __m512d dz = _mm512_sub_pd( _mm512_load_pd( &bodies->z[object_j] ), zi );
+            __m512d distance_squared =
+                _mm512_fmadd_pd( dx, dx, _mm512_fmadd_pd( dy, dy, _mm512_mul_pd( dz, dz ) ) );
+
+            // Lanes holding the self interaction are never divided; they stay zero.
+            __mmask8 nonzero = _mm512_cmp_pd_mask( distance_squared, zero, _CMP_GT_OQ );
+            __m512d  scale   = interaction_scale( _mm512_load_pd( &bodies->mu[object_j] ),
+                distance_squared, nonzero, iterations );
+
+            ax = _mm512_fmadd_pd( scale, dx, ax );
+            ay = _mm512_fmadd_pd( scale, dy, ay );
+            az = _mm512_fmadd_pd( scale, dz, az );
+        }
+
+        bodies->ax[object_i] = _mm512_reduce_add_pd( ax );
+        bodies->ay[object_i] = _mm512_reduce_add_pd( ay );
+        bodies->az[object_i] = _mm512_reduce_add_pd( az );
+    }
+}
+
+
+AVX512 void AllPairs_symmetric_avx512(
+    const BodyStore *bodies, int start_row, int stop_row, double *ax, double *ay, double *az )
+{
+    const __m512d zero       = _mm512_setzero_pd( );
+    const __m512d one        = _mm512_set1_pd( 1.0 );
+    const int     iterations = options.rsqrt_iterations;
+
+    for( int object_i = start_row; object_i < stop_row; ++object_i ) {
+        double mu_i              = bodies->mu[object_i];
+        double acceleration_i[3] = { 0.0, 0.0, 0.0 };
+        int    object_j          = object_i + 1;
+        int    aligned_j         = ( object_j + 7 ) & ~7;
+
+        // Handle single columns until the column index is a multiple of the vector width.
+        // Columns past the last body are padding and can be skipped.
+        for( ; object_j < aligned_j; ++object_j ) {
+            if( object_j < bodies->count )
+                AllPairs_symmetric_pair(
+                    bodies, object_i, object_j, mu_i, acceleration_i, ax, ay, az );
+        }
+
+        __m512d xi     = _mm512_set1_pd( bodies->x[object_i] );
+        __m512d yi     = _mm512_set1_pd( bodies->y[object_i] );
+        __m512d zi     = _mm512_set1_pd( bodies->z[object_i] );
+        __m512d mui    = _mm512_set1_pd( mu_i );
+        __m512d row_ax = zero;
+        __m512d row_ay = zero;
+        __m512d row_az = zero;
+
+        // The padding bodies have no mass so the accelerations they receive are harmless.
+        for( ; object_j < bodies->padded_count; object_j += 8 ) {
+            __m512d dx = _mm512_sub_pd( _mm512_load_pd( &bodies->x[object_j] ), xi );
+            __m512d dy = _mm512_sub_pd( _mm512_load_pd( &bodies->y[object_j] ), yi );
+            __m512d dz = _mm512_sub_pd( _mm512_load_pd( &bodies->z[object_j] ), zi );
+            __m512d distance_squared =
+                _mm512_fmadd_pd( dx, dx, _mm512_fmadd_pd( dy, dy, _mm512_mul_pd( dz, dz ) ) );
+            __mmask8 nonzero = _mm512_cmp_pd_mask( distance_squared, zero, _CMP_GT_OQ );
+            __m512d  inverse_cubed =
+                interaction_scale( one, distance_squared, nonzero, iterations );
+
+            // Each body's acceleration is due to the other body's gravitational parameter.
+            __m512d row_scale    =
+                _mm512_mul_pd( inverse_cubed, _mm512_load_pd( &bodies->mu[object_j] ) );
+            __m512d column_scale = _mm512_mul_pd( inverse_cubed, mui );
+
+            row_ax = _mm512_fmadd_pd( row_scale, dx, row_ax );
+            row_ay = _mm512_fmadd_pd( row_scale, dy, row_ay );
+            row_az = _mm512_fmadd_pd( row_scale, dz, row_az );
+            _mm512_store_pd( &ax[object_j],
+                _mm512_fnmadd_pd( column_scale, dx, _mm512_load_pd( &ax[object_j] ) ) );
+            _mm512_store_pd( &ay[object_j],
+                _mm512_fnmadd_pd( column_scale, dy, _mm512_load_pd( &ay[object_j] ) ) );
+            _mm512_store_pd( &az[object_j],
+                _mm512_fnmadd_pd( column_scale, dz, _mm512_load_pd( &az[object_j] ) ) );
+        }
+
+        ax[object_i] += acceleration_i[0] + _mm512_reduce_add_pd( row_ax );
+        ay[object_i] += acceleration_i[1] + _mm512_reduce_add_pd( row_ay );
+        az[object_i] += acceleration_i[2] + _mm512_reduce_add_pd( row_az );
+    }
+}
+
+//! Add the acceleration due to one body (broadcast in xj, yj, zj, muj) on eight bodies.
+AVX512 static inline void block_interaction(
+    __m512d xi, __m512d yi, __m512d zi, __m512d xj, __m512d yj, __m512d zj, __m512d muj,
+    int iterations, __m512d *ax, __m512d *ay, __m512d *az )
+{
+    __m512d dx = _mm512_sub_pd( xj, xi );
+    __m512d dy = _mm512_sub_pd( yj, yi );
+    __m512d dz = _mm512_sub_pd( zj, zi );
+    __m512d distance_squared =
+        _mm512_fmadd_pd( dx, dx, _mm512_fmadd_pd( dy, dy, _mm512_mul_pd( dz, dz ) ) );
+    __mmask8 nonzero = _mm512_cmp_pd_mask( distance_squared, _mm512_setzero_pd( ), _CMP_GT_OQ );
+    __m512d  scale   = interaction_scale( muj, distance_squared, nonzero, iterations );
+
+    *ax = _mm512_fmadd_pd( scale, dx, *ax );
+    *ay = _mm512_fmadd_pd( scale, dy, *ay );
+    *az = _mm512_fmadd_pd( scale, dz, *az );
+}
+
+
+//! Add the accumulated accelerations in ax, ay, and az to the store's arrays at 'index'.
+AVX512 static inline void block_store(
+    BodyStore *bodies, int index, __m512d ax, __m512d ay, __m512d az )
+{
+    _mm512_store_pd( &bodies->ax[index],
+        _mm512_add_pd( _mm512_load_pd( &bodies->ax[index] ), ax ) );
+    _mm512_store_pd( &bodies->ay[index],
+        _mm512_add_pd( _mm512_load_pd( &bodies->ay[index] ), ay ) );
+    _mm512_store_pd( &bodies->az[index],
+        _mm512_add_pd( _mm512_load_pd( &bodies->az[index] ), az ) );
+}
+
+
+// The rows are held in two vectors (16 bodies) when possible so each column is loaded and
+// broadcast once for 16 interactions. A final block of eight rows uses one vector.
+//
+AVX512 void AllPairs_block_avx512(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column )
+{
+    const int iterations = options.rsqrt_iterations;
+    int block = start_row;
+
+    for( ; block + 16 <= stop_row; block += 16 ) {
+        __m512d xi0 = _mm512_load_pd( &bodies->x[block] );
+        __m512d yi0 = _mm512_load_pd( &bodies->y[block] );
+        __m512d zi0 = _mm512_load_pd( &bodies->z[block] );
+        __m512d xi1 = _mm512_load_pd( &bodies->x[block + 8] );
+        __m512d yi1 = _mm512_load_pd( &bodies->y[block + 8] );
+        __m512d zi1 = _mm512_load_pd( &bodies->z[block + 8] );
+        __m512d ax0 = _mm512_setzero_pd( ), ay0 = ax0, az0 = ax0;
+        __m512d ax1 = ax0, ay1 = ax0, az1 = ax0;
+
+        for( int object_j = start_column; object_j < stop_column; ++object_j ) {
+            __m512d xj = _mm512_set1_pd( bodies->x[object_j] );
+            __m512d yj = _mm512_set1_pd( bodies->y[object_j] );
+            __m512d zj = _mm512_set1_pd( bodies->z[object_j] );
+            __m512d muj = _mm512_set1_pd( bodies->mu[object_j] );
+
+            block_interaction( xi0, yi0, zi0, xj, yj, zj, muj, iterations, &ax0, &ay0, &az0 );
+            block_interaction( xi1, yi1, zi1, xj, yj, zj, muj, iterations, &ax1, &ay1, &az1 );
+        }
+        block_store( bodies, block,     ax0, ay0, az0 );
+        block_store( bodies, block + 8, ax1, ay1, az1 );
+    }
+
+    if( block < stop_row ) {
+        __m512d xi = _mm512_load_pd( &bodies->x[block] );
+        __m512d yi = _mm512_load_pd( &bodies->y[block] );
+        __m512d zi = _mm512_load_pd( &bodies->z[block] );
+        __m512d ax = _mm512_setzero_pd( ), ay = ax, az = ax;
+
+        for( int object_j = start_column; object_j < stop_column; ++object_j ) {
+            block_interaction( xi, yi, zi,
+                _mm512_set1_pd( bodies->x[object_j] ), _mm512_set1_pd( bodies->y[object_j] ),
+                _mm512_set1_pd( bodies->z[object_j] ), _mm512_set1_pd( bodies->mu[object_j] ),
+                iterations, &ax, &ay, &az );
+        }
+        block_store( bodies, block, ax, ay, az );
+    }
+}
+
+
+// The generic kernel is inlined here so that it is vectorized for this instruction set.
+AVX512 void AllPairs_mixed_avx512( MixedTile *tile )
+{
+    AllPairs_mixed_generic( tile );
+}
+
+
+// One simulation per lane. A group of simulations fills one vector.
+AVX512 void AllPairs_ensemble_avx512( Ensemble *ensemble, int group )
+{
+    AllPairs_ensemble_generic( ensemble, group );
+}
+
+
+// A block of rows fills one vector.
+AVX512 void AllPairs_hermite_avx512(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column )
+{
+    AllPairs_hermite_generic( bodies, start_row, stop_row, start_column, stop_column );
+}
+
+
+// The fixed count kernels (see AllPairsKernels.h) compiled for this instruction set.
+ALLPAIRS_FIXED_TABLE( AllPairs_fixed_avx512, AVX512 )
+
+#endif
@@ -0,0 +1,423 @@
+/*! \file    AllPairsKernels.h
+ *  \brief   Instruction set specific all-pairs kernels (internal to the Common library).
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * Programs should not include this header. They should use the dispatching functions declared
+ * in AllPairs.h instead.
+ */
+
+#ifndef ALLPAIRSKERNELS_H
+#define ALLPAIRSKERNELS_H
+
+#include <math.h>
+#include "BodyStore.h"
+#include "Ensemble.h"
+#include "Options.h"
+
+// The vector kernels rely on the GCC/Clang target attribute so that they can be compiled into
+// the library without compiling the entire library for a processor that might not be present.
+#if ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) )
+#define ALLPAIRS_X86 1
+#else
+#define ALLPAIRS_X86 0
+#endif
+
+// The direct kernels compute the accelerations of bodies [start_index, stop_index).
+void AllPairs_forces_scalar( BodyStore *bodies, int start_index, int stop_index );
+
+// The symmetric kernels visit the pairs (i, j) with start_row <= i < stop_row and j > i. The
+// accelerations are added to (not stored in) the given arrays.
+void AllPairs_symmetric_scalar(
+    const BodyStore *bodies, int start_row, int stop_row, double *ax, double *ay, double *az );
+
+// The block kernels add the sum over columns [start_column, stop_column) of mu_j * d_ij /
+// r_ij^3 to the ax, ay, and az arrays for rows [start_row, stop_row). The row indices must be
+// multiples of BODYSTORE_PADDING. Several rows are updated for each column loaded (register
+// blocking).
+void AllPairs_block_scalar(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column );
+
+//! Number of rows the mixed precision kernels process at once. Row counts are multiples of it.
+#define ALLPAIRS_MIXED_ROWS 16
+
+//! Number of columns summed in single precision before the sum is added in double precision.
+#define ALLPAIRS_MIXED_CHUNK 8
+
+//! Structure that describes one tile of the mixed precision computation.
+/*!
+ * Positions are in astronomical units relative to an origin near the rows of the tile, so
+ * that single precision resolves the separations of nearby bodies. Gravitational parameters are
+ * relative to the largest in the store. For each row the sum over columns of mu_j * d_ij /
+ * r_ij^3 is added to sum[] with its rounding error kept in compensation[] (Neumaier's
+ * summation).
+ */
+typedef struct {
+    int     row_count;
+    int     column_count;
+    float  *row_x, *row_y, *row_z;
+    float  *column_x, *column_y, *column_z, *column_mu;
+    double *sum[3];
+    double *compensation[3];
+} MixedTile;
+
+void AllPairs_mixed_scalar( MixedTile *tile );
+
+// The ensemble kernels compute the accelerations of all bodies in one group of the ensemble.
+void AllPairs_ensemble_scalar( Ensemble *ensemble, int group );
+
+// The Hermite kernels add the accelerations and jerks due to columns [start_column,
+// stop_column) to the acceleration and jerk arrays for rows [start_row, stop_row).
+void AllPairs_hermite_scalar(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column );
+
+#if ALLPAIRS_X86
+void AllPairs_forces_avx2( BodyStore *bodies, int start_index, int stop_index );
+void AllPairs_forces_avx512( BodyStore *bodies, int start_index, int stop_index );
+
+void AllPairs_symmetric_avx2(
+    const BodyStore *bodies, int start_row, int stop_row, double *ax, double *ay, double *az );
+void AllPairs_symmetric_avx512(
+    const BodyStore *bodies, int start_row, int stop_row, double *ax, double *ay, double *az );
+
+void AllPairs_block_avx2(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column );
+void AllPairs_block_avx512(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column );
+
+void AllPairs_mixed_avx2( MixedTile *tile );
+void AllPairs_mixed_avx512( MixedTile *tile );
+
+void AllPairs_ensemble_avx2( Ensemble *ensemble, int group );
+void AllPairs_ensemble_avx512( Ensemble *ensemble, int group );
+
+void AllPairs_hermite_avx2(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column );
+void AllPairs_hermite_avx512(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column );
+#endif
+
+//! The largest body count for which a specialized kernel exists. The smallest is two.
+#define ALLPAIRS_FIXED_MAX 16
+
+//! Kernel that computes the accelerations of all bodies of a store with a particular count.
+typedef void ( *AllPairsFixedKernel )( BodyStore *bodies );
+
+// Tables of the fixed count kernels indexed by body count. Unused entries are NULL.
+extern const AllPairsFixedKernel AllPairs_fixed_scalar[ALLPAIRS_FIXED_MAX + 1];
+#if ALLPAIRS_X86
+extern const AllPairsFixedKernel AllPairs_fixed_avx2[ALLPAIRS_FIXED_MAX + 1];
+extern const AllPairsFixedKernel AllPairs_fixed_avx512[ALLPAIRS_FIXED_MAX + 1];
+#endif
+
+//! Apply the forces between one pair of bodies. Vector kernels use this for unaligned columns.
+/*!
+ * The acceleration of object_i is added to acceleration_i and that of object_j to the arrays.
+ * The argument mu_i is the gravitational parameter of object_i.
+ */
+static inline void AllPairs_symmetric_pair(
+    const BodyStore *bodies, int object_i, int object_j, double mu_i, double acceleration_i[3],
+    double *ax, double *ay, double *az )
+{
+    double dx = bodies->x[object_j] - bodies->x[object_i];
+    double dy = bodies->y[object_j] - bodies->y[object_i];
+    double dz = bodies->z[object_j] - bodies->z[object_i];
+    double distance_squared = dx * dx + dy * dy + dz * dz;
+
+    if( distance_squared == 0.0 ) return;
+    double scale = 1.0 / ( distance_squared * sqrt( distance_squared ) );
+    double mu_j  = bodies->mu[object_j];
+    acceleration_i[0] += mu_j * scale * dx;
+    acceleration_i[1] += mu_j * scale * dy;
+    acceleration_i[2] += mu_j * scale * dz;
+    ax[object_j] -= mu_i * scale * dx;
+    ay[object_j] -= mu_i * scale * dy;
+    az[object_j] -= mu_i * scale * dz;
+}
+
+//! Add 'value' to the compensated sum held in *sum and *compensation.
+static inline void AllPairs_neumaier_add( double *sum, double *compensation, double value )
+{
+    double total = *sum + value;
+
+    // Recover the low order bits lost by whichever operand has the smaller magnitude.
+    *compensation += ( fabs( *sum ) >= fabs( value ) ) ?
+        ( *sum - total ) + value : ( value - total ) + *sum;
+    *sum = total;
+}
+
+
+//! Add the interactions described by 'tile' to its sums.
+/*!
+ * Each instruction set specific mixed precision kernel is this function compiled for that
+ * instruction set. The loops over the rows of a block have a fixed trip count and independent
+ * iterations so the compiler turns them into vector instructions. Single precision doubles the
+ * number of interactions per instruction compared to the double precision kernels.
+ */
+static inline void AllPairs_mixed_generic( MixedTile *tile )
+{
+    for( int block = 0; block < tile->row_count; block += ALLPAIRS_MIXED_ROWS ) {
+        const float *xi = tile->row_x + block;
+        const float *yi = tile->row_y + block;
+        const float *zi = tile->row_z + block;
+
+        for( int chunk = 0; chunk < tile->column_count; chunk += ALLPAIRS_MIXED_CHUNK ) {
+            int   chunk_end = ( tile->column_count - chunk < ALLPAIRS_MIXED_CHUNK ) ?
+                tile->column_count : chunk + ALLPAIRS_MIXED_CHUNK;
+            float ax[ALLPAIRS_MIXED_ROWS] = { 0.0f };
+            float ay[ALLPAIRS_MIXED_ROWS] = { 0.0f };
+            float az[ALLPAIRS_MIXED_ROWS] = { 0.0f };
+
+            for( int object_j = chunk; object_j < chunk_end; ++object_j ) {
+                float xj = tile->column_x[object_j];
+                float yj = tile->column_y[object_j];
+                float zj = tile->column_z[object_j];
+                float mu = tile->column_mu[object_j];
+
+                for( int k = 0; k < ALLPAIRS_MIXED_ROWS; ++k ) {
+                    float dx = xj - xi[k];
+                    float dy = yj - yi[k];
+                    float dz = zj - zi[k];
+                    float distance_squared = dx * dx + dy * dy + dz * dz;
+                    float inverse = 1.0f / sqrtf( distance_squared );
+                    float scale   = ( distance_squared > 0.0f ) ?
+                        mu * inverse * inverse * inverse : 0.0f;
+                    ax[k] += scale * dx;
+                    ay[k] += scale * dy;
+                    az[k] += scale * dz;
+                }
+            }
+
+            const float *partial[3] = { ax, ay, az };
+            for( int c = 0; c < 3; ++c ) {
+                double *restrict sum          = tile->sum[c] + block;
+                double *restrict compensation = tile->compensation[c] + block;
+
+                for( int k = 0; k < ALLPAIRS_MIXED_ROWS; ++k ) {
+                    AllPairs_neumaier_add( &sum[k], &compensation[k], partial[c][k] );
+                }
+            }
+        }
+    }
+}
+
+
+//! Compute the accelerations of all 'count' bodies of the store.
+/*!
+ * This function is only called with a constant 'count' and it is always inlined, so each call
+ * produces code specialized for one body count. Both loops over the pairs are then unrolled
+ * completely: every pair (i, j) with j > i becomes straight line code with its indices fixed at
+ * compile time. There is no loop control and, since a body is never paired with itself, no test
+ * for the self interaction. The bodies are copied into local arrays so that the compiler can
+ * keep them in registers.
+ */
+static inline __attribute__(( always_inline )) void AllPairs_fixed_generic(
+    BodyStore *bodies, const int count )
+{
+    double x[ALLPAIRS_FIXED_MAX], y[ALLPAIRS_FIXED_MAX], z[ALLPAIRS_FIXED_MAX];
+    double mu[ALLPAIRS_FIXED_MAX];
+    double ax[ALLPAIRS_FIXED_MAX], ay[ALLPAIRS_FIXED_MAX], az[ALLPAIRS_FIXED_MAX];
+
+    for( int i = 0; i < count; ++i ) {
+        x[i]  = bodies->x[i];
+        y[i]  = bodies->y[i];
+        z[i]  = bodies->z[i];
+        mu[i] = bodies->mu[i];
+        ax[i] = ay[i] = az[i] = 0.0;
+    }
+
+    #pragma GCC unroll 16
+    for( int i = 0; i < count; ++i ) {
+        #pragma GCC unroll 16
+        for( int j = i + 1; j < count; ++j ) {
+            double dx = x[j] - x[i];
+            double dy = y[j] - y[i];
+            double dz = z[j] - z[i];
+            double distance_squared = dx * dx + dy * dy + dz * dz;
+            double scale = 1.0 / ( distance_squared * sqrt( distance_squared ) );
+
+            ax[i] += mu[j] * scale * dx;
+            ay[i] += mu[j] * scale * dy;
+            az[i] += mu[j] * scale * dz;
+            ax[j] -= mu[i] * scale * dx;
+            ay[j] -= mu[i] * scale * dy;
+            az[j] -= mu[i] * scale * dz;
+        }
+    }
+
+    for( int i = 0; i < count; ++i ) {
+        bodies->ax[i] = ax[i];
+        bodies->ay[i] = ay[i];
+        bodies->az[i] = az[i];
+    }
+}
+
+//! Define the kernels of AllPairs_fixed_generic for each body count and a table of them.
+/*!
+ * The kernels are named name_2 through name_16 and the table is named 'name'. The 'attribute'
+ * is applied to each kernel so that it is compiled for a particular instruction set.
+ */
+#define ALLPAIRS_FIXED_KERNEL( name, attribute, count ) \
+    attribute static void name##_##count( BodyStore *bodies ) \
+    { \
+        AllPairs_fixed_generic( bodies, count ); \
+    }
+
+#define ALLPAIRS_FIXED_TABLE( name, attribute ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  2 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  3 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  4 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  5 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  6 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  7 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  8 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute,  9 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute, 10 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute, 11 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute, 12 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute, 13 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute, 14 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute, 15 ) \
+    ALLPAIRS_FIXED_KERNEL( name, attribute, 16 ) \
+    const AllPairsFixedKernel name[ALLPAIRS_FIXED_MAX + 1] = { \
+        NULL,     NULL,     name##_2,  name##_3,  name##_4,  name##_5,  name##_6, \
+        name##_7, name##_8, name##_9,  name##_10, name##_11, name##_12, name##_13, \
+        name##_14, name##_15, name##_16 \
+    };
+
+
+//! Add the accelerations of body i due to bodies [start_j, stop_j) in every lane of a group.
+/*!
+ * The arrays are those of one group of an ensemble, offset so that body zero is at index zero.
+ * The loop over the lanes has a fixed trip count and independent iterations, so the compiler
+ * turns it into vector instructions with one simulation per lane.
+ */
+static inline void AllPairs_ensemble_row(
+    const double *restrict x, const double *restrict y, const double *restrict z,
+    const double *restrict mu, int i, int start_j, int stop_j,
+    double *restrict ax, double *restrict ay, double *restrict az )
+{
+    const double *xi = x + i * ENSEMBLE_LANES;
+    const double *yi = y + i * ENSEMBLE_LANES;
+    const double *zi = z + i * ENSEMBLE_LANES;
+
+    for( int j = start_j; j < stop_j; ++j ) {
+        const double *xj  = x  + j * ENSEMBLE_LANES;
+        const double *yj  = y  + j * ENSEMBLE_LANES;
+        const double *zj  = z  + j * ENSEMBLE_LANES;
+        const double *muj = mu + j * ENSEMBLE_LANES;
+
+        for( int lane = 0; lane < ENSEMBLE_LANES; ++lane ) {
+            double dx = xj[lane] - xi[lane];
+            double dy = yj[lane] - yi[lane];
+            double dz = zj[lane] - zi[lane];
+            double distance_squared = dx * dx + dy * dy + dz * dz;
+            double scale = muj[lane] / ( distance_squared * sqrt( distance_squared ) );
+
+            ax[lane] += scale * dx;
+            ay[lane] += scale * dy;
+            az[lane] += scale * dz;
+        }
+    }
+}
+
+
+//! Compute the accelerations of all bodies in group 'group' of the ensemble.
+/*!
+ * Each instruction set specific ensemble kernel is this function compiled for that instruction
+ * set. The bodies before and after body i are handled by separate loops so that there is no
+ * test for the self interaction. Bodies of the same simulation must not share a position.
+ */
+static inline void AllPairs_ensemble_generic( Ensemble *ensemble, int group )
+{
+    int    count  = ensemble->count;
+    size_t offset = (size_t)group * count * ENSEMBLE_LANES;
+    const double *x  = ensemble->x  + offset;
+    const double *y  = ensemble->y  + offset;
+    const double *z  = ensemble->z  + offset;
+    const double *mu = ensemble->mu + offset;
+
+    for( int i = 0; i < count; ++i ) {
+        double ax[ENSEMBLE_LANES] = { 0.0 };
+        double ay[ENSEMBLE_LANES] = { 0.0 };
+        double az[ENSEMBLE_LANES] = { 0.0 };
+
+        AllPairs_ensemble_row( x, y, z, mu, i, 0, i, ax, ay, az );
+        AllPairs_ensemble_row( x, y, z, mu, i, i + 1, count, ax, ay, az );
+
+        double *restrict result_x = ensemble->ax + offset + i * ENSEMBLE_LANES;
+        double *restrict result_y = ensemble->ay + offset + i * ENSEMBLE_LANES;
+        double *restrict result_z = ensemble->az + offset + i * ENSEMBLE_LANES;
+        for( int lane = 0; lane < ENSEMBLE_LANES; ++lane ) {
+            result_x[lane] = ax[lane];
+            result_y[lane] = ay[lane];
+            result_z[lane] = az[lane];
+        }
+    }
+}
+
+
+//! Add the accelerations and jerks due to a range of columns to a range of rows.
+/*!
+ * Each instruction set specific Hermite kernel is this function compiled for that instruction
+ * set. For body i the acceleration due to body j is mu_j * d / r^3 and the jerk (its time
+ * derivative) is mu_j * ( v / r^3 - 3 (d . v) d / r^5 ), where d and v are the position and
+ * velocity of j relative to i. The rows are processed in aligned blocks of BODYSTORE_PADDING,
+ * as in the block kernels, so the loop over the rows of a block is vectorized. Rows of a block
+ * outside [start_row, stop_row) are computed but not stored, so the range need not be aligned.
+ */
+static inline void AllPairs_hermite_generic(
+    BodyStore *bodies, int start_row, int stop_row, int start_column, int stop_column )
+{
+    const double *restrict x  = bodies->x;
+    const double *restrict y  = bodies->y;
+    const double *restrict z  = bodies->z;
+    const double *restrict vx = bodies->vx;
+    const double *restrict vy = bodies->vy;
+    const double *restrict vz = bodies->vz;
+    const double *restrict mu = bodies->mu;
+
+    for( int block = start_row & ~( BODYSTORE_PADDING - 1 );
+         block < stop_row; block += BODYSTORE_PADDING ) {
+        double ax[BODYSTORE_PADDING] = { 0.0 };
+        double ay[BODYSTORE_PADDING] = { 0.0 };
+        double az[BODYSTORE_PADDING] = { 0.0 };
+        double jx[BODYSTORE_PADDING] = { 0.0 };
+        double jy[BODYSTORE_PADDING] = { 0.0 };
+        double jz[BODYSTORE_PADDING] = { 0.0 };
+
+        for( int object_j = start_column; object_j < stop_column; ++object_j ) {
+            for( int k = 0; k < BODYSTORE_PADDING; ++k ) {
+                double dx  = x[object_j]  - x[block + k];
+                double dy  = y[object_j]  - y[block + k];
+                double dz  = z[object_j]  - z[block + k];
+                double dvx = vx[object_j] - vx[block + k];
+                double dvy = vy[object_j] - vy[block + k];
+                double dvz = vz[object_j] - vz[block + k];
+                double distance_squared = dx * dx + dy * dy + dz * dz;
+                double inverse_squared  =
+                    ( distance_squared > 0.0 ) ? 1.0 / distance_squared : 0.0;
+                double scale = mu[object_j] * inverse_squared * sqrt( inverse_squared );
+                double rate  = 3.0 * ( dx * dvx + dy * dvy + dz * dvz ) * inverse_squared;
+
+                ax[k] += scale * dx;
+                ay[k] += scale * dy;
+                az[k] += scale * dz;
+                jx[k] += scale * ( dvx - rate * dx );
+                jy[k] += scale * ( dvy - rate * dy );
+                jz[k] += scale * ( dvz - rate * dz );
+            }
+        }
+
+        for( int k = 0; k < BODYSTORE_PADDING; ++k ) {
+            if( block + k < start_row || block + k >= stop_row ) continue;
+            bodies->ax[block + k] += ax[k];
+            bodies->ay[block + k] += ay[k];
+            bodies->az[block + k] += az[k];
+            bodies->jx[block + k] += jx[k];
+            bodies->jy[block + k] += jy[k];
+            bodies->jz[block + k] += jz[k];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,238 @@
+/*! \file    Autotune.c
+ *  \brief   Implementation of the tuner of the run time options.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "global.h"
+#include "Autotune.h"
+#include "Integrator.h"
+#include "Options.h"
+#include "Timer.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+// Each trial runs at least this long (in milliseconds) so that the timer's resolution and the
+// noise of the system are small compared with the time measured.
+#define TRIAL_TIME 200
+
+// A candidate must be faster by at least this fraction to replace the best value so far. This
+// keeps the tuner from chasing noise.
+#define IMPROVEMENT 0.02
+
+// The tuner gives up after this many passes over the options even if they are still changing.
+#define MAXIMUM_PASSES 3
+
+// Candidate values are formatted into arrays of strings of this size.
+#define MAXIMUM_CANDIDATES 32
+#define VALUE_SIZE         32
+
+//! Structure that holds the values to try for one option.
+struct CandidateList {
+    int  count;
+    char values[MAXIMUM_CANDIDATES][VALUE_SIZE];
+};
+
+// The initial state of the simulation. It is restored before every trial.
+PRIVATE ObjectDynamics *initial_dynamics;
+
+
+//! Add an integer candidate to the list unless it is already there.
+PRIVATE void add_integer( struct CandidateList *list, int value )
+{
+    char text[VALUE_SIZE];
+
+    snprintf( text, sizeof( text ), "%d", value );
+    for( int i = 0; i < list->count; ++i ) {
+        if( strcmp( list->values[i], text ) == 0 ) return;
+    }
+    if( list->count < MAXIMUM_CANDIDATES ) strcpy( list->values[list->count++], text );
+}
+
+
+//! Fill in the candidates for the named option.
+/*!
+ * \return Zero if successful or -1 if the tuner does not know the option.
+ */
+PRIVATE int make_candidates( const char *name, struct CandidateList *list )
+{
+    static const char *force_methods[] = { "direct", "symmetric", "tiled" };
+    static const char *angles[] = { "0.3", "0.4", "0.5", "0.6", "0.7", "0.8", "0.9", "1.0" };
+    static const char *tree_builders[] = { "insert", "morton" };
+    static const char *openings[] = { "size", "radius" };
+
+    list->count = 0;
+    if( strcmp( name, "force" ) == 0 ) {
+        for( int i = 0; i < 3; ++i ) strcpy( list->values[list->count++], force_methods[i] );
+    }
+    else if( strcmp( name, "tile-rows" ) == 0 ) {
+        for( int size = 32; size <= 1024; size *= 2 ) add_integer( list, size );
+    }
+    else if( strcmp( name, "tile-columns" ) == 0 ) {
+        for( int size = 128; size <= 8192; size *= 2 ) add_integer( list, size );
+    }
+    else if( strcmp( name, "threads" ) == 0 ) {
+        int processor_count;
+
+        // Find the processor count with threads unset, then put the option back.
+        int saved_threads = options.threads;
+        options.threads = 0;
+        processor_count = Options_thread_count( );
+        options.threads = saved_threads;
+        for( int count = 1; count < processor_count; count *= 2 ) add_integer( list, count );
+        add_integer( list, processor_count );
+    }
+    else if( strcmp( name, "chunk-size" ) == 0 ) {
+        // Zero gives each thread one contiguous share. The others split the shares further.
+        int thread_count = Options_thread_count( );
+
+        add_integer( list, 0 );
+        for( int pieces = 2; pieces <= 64; pieces *= 2 ) {
+            int size = OBJECT_COUNT / ( pieces * thread_count );
+            if( size >= 1 ) add_integer( list, size );
+        }
+    }
+    else if( strcmp( name, "theta" ) == 0 ) {
+        for( int i = 0; i < 8; ++i ) strcpy( list->values[list->count++], angles[i] );
+    }
+    else if( strcmp( name, "leaf-size" ) == 0 ) {
+        for( int size = 1; size <= 32; size *= 2 ) add_integer( list, size );
+    }
+    else if( strcmp( name, "tree-builder" ) == 0 ) {
+        for( int i = 0; i < 2; ++i ) strcpy( list->values[list->count++], tree_builders[i] );
+    }
+    else if( strcmp( name, "opening" ) == 0 ) {
+        for( int i = 0; i < 2; ++i ) strcpy( list->values[list->count++], openings[i] );
+    }
+    else {
+        return -1;
+    }
+    return 0;
+}
+
+
+//! Put the simulation back in its initial state.
+PRIVATE void restore( void )
+{
+    memcpy( current_dynamics, initial_dynamics, OBJECT_COUNT * sizeof(ObjectDynamics) );
+    Integrator_reset( );
+}
+
+
+//! Return the time per step, in milliseconds, of the current options.
+PRIVATE double measure( AutotuneAdvance advance )
+{
+    Timer stopwatch;
+    int   step_count = 1;
+
+    // Each attempt doubles the number of steps until the trial takes long enough to time.
+    while( 1 ) {
+        long elapsed;
+
+        restore( );
+        Timer_initialize( &stopwatch );
+        Timer_start( &stopwatch );
+        advance( step_count );
+        Timer_stop( &stopwatch );
+        elapsed = Timer_time( &stopwatch );
+        if( elapsed >= TRIAL_TIME ) return (double)elapsed / step_count;
+        step_count *= 2;
+    }
+}
+
+
+//! Create the directory that will hold the profile named by 'path' if it does not exist.
+PRIVATE void make_profile_directory( const char *path )
+{
+    char  directory[1024];
+    char *slash;
+
+    snprintf( directory, sizeof( directory ), "%s", path );
+    if( ( slash = strrchr( directory, '/' ) ) == NULL ) return;
+    *slash = '\0';
+    if( mkdir( directory, 0755 ) != 0 && errno != EEXIST ) {
+        fprintf( stderr, "Unable to create %s\n", directory );
+    }
+}
+
+
+PUBLIC int Autotune_run(
+    const char *const *names, AutotuneAdvance advance, AutotuneError error )
+{
+    const char *path = Options_profile_path( );
+    double      error_bound;
+    double      best_time;
+    int         changed = 1;
+    int         status  = 0;
+    FILE       *profile;
+
+    initial_dynamics = (ObjectDynamics *)malloc( OBJECT_COUNT * sizeof(ObjectDynamics) );
+    if( initial_dynamics == NULL ) {
+        fprintf( stderr, "Unable to save the initial state for tuning\n" );
+        return -1;
+    }
+    memcpy( initial_dynamics, current_dynamics, OBJECT_COUNT * sizeof(ObjectDynamics) );
+
+    error_bound = options.error_bound;
+    if( error != NULL && error_bound == 0.0 ) error_bound = error( );
+    best_time = measure( advance );
+    fprintf( stderr, "Tuning: initial settings take %.3f ms per step\n", best_time );
+
+    for( int pass = 0; changed && pass < MAXIMUM_PASSES; ++pass ) {
+        changed = 0;
+        for( int i = 0; names[i] != NULL; ++i ) {
+            struct CandidateList candidates;
+            char   best_value[VALUE_SIZE];
+
+            if( Options_get( names[i], best_value, sizeof( best_value ) ) != 0 ||
+                make_candidates( names[i], &candidates ) != 0 ) continue;
+
+            for( int j = 0; j < candidates.count; ++j ) {
+                double trial_error = 0.0;
+                double trial_time;
+
+                if( strcmp( candidates.values[j], best_value ) == 0 ||
+                    Options_set( names[i], candidates.values[j] ) != 0 ) continue;
+                restore( );
+                if( error != NULL && ( trial_error = error( ) ) > error_bound ) {
+                    fprintf( stderr, "Tuning: %s=%s rejected (error %.3E)\n",
+                             names[i], candidates.values[j], trial_error );
+                    continue;
+                }
+                trial_time = measure( advance );
+                fprintf( stderr, "Tuning: %s=%s takes %.3f ms per step\n",
+                         names[i], candidates.values[j], trial_time );
+                if( trial_time < ( 1.0 - IMPROVEMENT ) * best_time ) {
+                    best_time = trial_time;
+                    strcpy( best_value, candidates.values[j] );
+                    changed = 1;
+                }
+            }
+            if( Options_set( names[i], best_value ) != 0 ) {
+                fprintf( stderr, "Tuning: unable to restore %s=%s\n", names[i], best_value );
+                status = -1;
+            }
+        }
+    }
+
+    restore( );
+    free( initial_dynamics );
+    if( status != 0 ) return -1;
+
+    make_profile_directory( path );
+    if( ( profile = fopen( path, "w" ) ) == NULL ) {
+        fprintf( stderr, "Unable to write the tuning profile %s\n", path );
+        return -1;
+    }
+    fprintf( profile, "# Written by --autotune=on (%.3f ms per step)\n", best_time );
+    Options_write( profile, names );
+    fclose( profile );
+    fprintf( stderr, "Tuning: saved the best settings in %s\n", path );
+    return 0;
+}
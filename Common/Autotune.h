@@ -0,0 +1,49 @@
+/*! \file    Autotune.h
+ *  \brief   Interface to the tuner of the run time options.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The best tile sizes, thread count, and so forth depend on the machine. The tuner finds good
+ * values by timing the simulation itself. It varies one option at a time, keeping each change
+ * that makes a step faster, and repeats until a pass over the options changes nothing. Options
+ * that trade accuracy for speed (such as the Barnes-Hut opening angle) are only accepted when
+ * the program's error measure stays within options.error_bound or, if that is zero, within the
+ * error of the settings in effect when tuning started. The result is written to the host's
+ * profile (see Options_profile_path) so that later runs start with the tuned settings.
+ */
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Function that advances the simulation in current_dynamics by 'step_count' time steps.
+typedef void (*AutotuneAdvance)( int step_count );
+
+//! Function that returns the approximation error of the current options (for example, the
+//! relative error of the forces compared with a direct sum).
+typedef double (*AutotuneError)( void );
+
+//! Tune the named options and save them in the host's profile.
+/*!
+ * The state of the simulation in current_dynamics is restored before each trial and after
+ * tuning so the simulation proper starts from its initial conditions. When this function
+ * returns the options are set to the best values found.
+ *
+ * \param names A NULL terminated list of the names of the options to tune. The tuner knows
+ * suitable candidate values for force, tile-rows, tile-columns, threads, chunk-size, theta,
+ * leaf-size, tree-builder, and opening. Other names are ignored.
+ * \param advance The function used to time the simulation.
+ * \param error The function used to measure accuracy, or NULL if none of the options tuned
+ * affect accuracy.
+ * \return Zero if successful or -1 if memory could not be allocated, an option could not be
+ * set to its best value, or the profile could not be written.
+ */
+int Autotune_run( const char *const *names, AutotuneAdvance advance, AutotuneError error );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/*! \file    BodyStore.c
+ *  \brief   Implementation of the structure-of-arrays body storage.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "BodyStore.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+#define CACHE_LINE_SIZE 64
+
+//! Allocate a zero filled, cache line aligned array of 'count' doubles.
+PRIVATE double *allocate_array( int count )
+{
+    void *result;
+
+    if( posix_memalign( &result, CACHE_LINE_SIZE, count * sizeof(double) ) != 0 ) return NULL;
+    memset( result, 0, count * sizeof(double) );
+    return (double *)result;
+}
+
+
+PUBLIC int BodyStore_initialize( BodyStore *self, int count )
+{
+    int padded_count =
+        ( ( count + BODYSTORE_PADDING - 1 ) / BODYSTORE_PADDING ) * BODYSTORE_PADDING;
+
+    self->count        = count;
+    self->padded_count = padded_count;
+    self->x    = allocate_array( padded_count );
+    self->y    = allocate_array( padded_count );
+    self->z    = allocate_array( padded_count );
+    self->vx   = allocate_array( padded_count );
+    self->vy   = allocate_array( padded_count );
+    self->vz   = allocate_array( padded_count );
+    self->mu   = allocate_array( padded_count );
+    self->ax   = allocate_array( padded_count );
+    self->ay   = allocate_array( padded_count );
+    self->az   = allocate_array( padded_count );
+    self->jx   = allocate_array( padded_count );
+    self->jy   = allocate_array( padded_count );
+    self->jz   = allocate_array( padded_count );
+    self->thread_count      = 1;
+    self->accumulator_count = 0;
+    self->accumulators      = NULL;
+
+    if( self->x  == NULL || self->y  == NULL || self->z  == NULL ||
+        self->vx == NULL || self->vy == NULL || self->vz == NULL || self->mu == NULL ||
+        self->ax == NULL || self->ay == NULL || self->az == NULL ||
+        self->jx == NULL || self->jy == NULL || self->jz == NULL ) {
+        BodyStore_destroy( self );
+        return -1;
+    }
+    return 0;
+}
+
+
+PUBLIC void BodyStore_destroy( BodyStore *self )
+{
+    // It is safe to pass NULL to free( ).
+    free( self->x  ); free( self->y  ); free( self->z  );
+    free( self->vx ); free( self->vy ); free( self->vz );
+    free( self->mu );
+    free( self->ax ); free( self->ay ); free( self->az );
+    free( self->jx ); free( self->jy ); free( self->jz );
+    free( self->accumulators );
+
+    // Put the left over store into a well defined state.
+    memset( self, 0, sizeof(BodyStore) );
+}
+
+
+PUBLIC int BodyStore_reserve( BodyStore *self, int count )
+{
+    double *new_accumulators;
+
+    if( count <= self->accumulator_count ) return 0;
+
+    // Each additional thread needs three acceleration arrays.
+    if( ( new_accumulators = allocate_array( 3 * count * self->padded_count ) ) == NULL )
+        return -1;
+    free( self->accumulators );
+    self->accumulators      = new_accumulators;
+    self->accumulator_count = count;
+    return 0;
+}
+
+
+PUBLIC void BodyStore_load_parameters( BodyStore *self, const Object *objects )
+{
+    for( int i = 0; i < self->count; ++i ) {
+        self->mu[i] = objects[i].mu;
+    }
+}
+
+
+PUBLIC void BodyStore_load(
+    BodyStore *self, const ObjectDynamics *dynamics, int start_index, int stop_index )
+{
+    for( int i = start_index; i < stop_index; ++i ) {
+        self->x[i]  = dynamics[i].position.x;
+        self->y[i]  = dynamics[i].position.y;
+        self->z[i]  = dynamics[i].position.z;
+        self->vx[i] = dynamics[i].velocity.x;
+        self->vy[i] = dynamics[i].velocity.y;
+        self->vz[i] = dynamics[i].velocity.z;
+    }
+}
@@ -0,0 +1,116 @@
+/*! \file    BodyStore.h
+ *  \brief   Structure-of-arrays storage of the bodies used by the force kernels.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#ifndef BODYSTORE_H
+#define BODYSTORE_H
+
+#include "global.h"
+
+//! Structure that holds the object data as separate component arrays.
+/*!
+ * The ObjectDynamics array interleaves positions and velocities. That is convenient for most of
+ * the program but it means the x coordinates of consecutive objects are 48 bytes apart, so a
+ * vector unit can't load them with a single instruction. This structure keeps each component
+ * in its own array so the force kernels (see AllPairs.h) can stream through the bodies with
+ * full width vector loads.
+ *
+ * Every array is aligned to a cache line and is padded to a multiple of BODYSTORE_PADDING
+ * elements. The padding bodies have zero mass and sit at the origin. Kernels can thus process
+ * whole vectors without a scalar tail loop; the padding contributes no force.
+ *
+ * Bodies are described by their gravitational parameter mu = G * m rather than their mass, and
+ * the kernels compute accelerations rather than forces. The acceleration of body i is the sum
+ * of mu_j * d_ij / r_ij^3. This saves multiplying by m_i only to divide by it again and keeps
+ * the intermediate values within a range single precision can represent.
+ *
+ * Kernels that add accelerations to other bodies' totals (see AllPairs_compute) need a private
+ * set of arrays for each thread so they can work without locks. The first thread uses ax, ay,
+ * and az directly. The others use the accumulators reserved with BodyStore_reserve.
+ */
+typedef struct {
+    int     count;          //!< Number of real bodies in the store.
+    int     padded_count;   //!< Number of elements allocated in each array.
+    double *x,  *y,  *z;    //!< Positions.
+    double *vx, *vy, *vz;   //!< Velocities.
+    double *mu;             //!< Gravitational parameters (G times the mass).
+    double *ax, *ay, *az;   //!< Total acceleration of each body (written by the kernels).
+    double *jx, *jy, *jz;   //!< Total jerk of each body (written by the Hermite kernels).
+    int     thread_count;   //!< Number of threads sharing the current force computation.
+    int     accumulator_count;  //!< Number of sets of per-thread arrays allocated.
+    double *accumulators;       //!< The per-thread arrays. See BodyStore_accumulator.
+} BodyStore;
+
+//! The number of elements each array is padded to. This is the width of an AVX-512 register.
+#define BODYSTORE_PADDING 8
+
+//! The body store shared by the all-pairs programs. It is set up by initialize_object_arrays.
+extern BodyStore body_store;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Allocate the arrays for 'count' bodies.
+/*!
+ * All elements, including the padding, are initialized to zero.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int BodyStore_initialize( BodyStore *self, int count );
+
+//! Release the arrays held by the store.
+void BodyStore_destroy( BodyStore *self );
+
+//! Ensure there are per-thread acceleration arrays for at least 'count' additional threads.
+/*!
+ * This function must not be called while kernels are using the store.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int BodyStore_reserve( BodyStore *self, int count );
+
+//! Copy the gravitational parameters of all the bodies from an Object array.
+void BodyStore_load_parameters( BodyStore *self, const Object *objects );
+
+//! Copy the positions and velocities of bodies [start_index, stop_index) from a dynamics array.
+void BodyStore_load(
+    BodyStore *self, const ObjectDynamics *dynamics, int start_index, int stop_index );
+
+//! Return the acceleration of a body as computed by the most recent kernel invocation.
+static inline Vector3 BodyStore_acceleration( const BodyStore *self, int index )
+{
+    Vector3 result;
+    result.x = self->ax[index];
+    result.y = self->ay[index];
+    result.z = self->az[index];
+    return result;
+}
+
+//! Return the jerk (the rate of change of the acceleration) of a body as computed by the most
+//! recent Hermite kernel invocation.
+static inline Vector3 BodyStore_jerk( const BodyStore *self, int index )
+{
+    Vector3 result;
+    result.x = self->jx[index];
+    result.y = self->jy[index];
+    result.z = self->jz[index];
+    return result;
+}
+
+//! Return one component array (0 = x, 1 = y, 2 = z) of the acceleration arrays of a thread.
+static inline double *BodyStore_accumulator(
+    const BodyStore *self, int thread_id, int component )
+{
+    if( thread_id == 0 ) {
+        return ( component == 0 ) ? self->ax : ( component == 1 ) ? self->ay : self->az;
+    }
+    return self->accumulators + ( 3 * ( thread_id - 1 ) + component ) * self->padded_count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,208 @@
+/*! \file    DenseOutput.c
+ *  \brief   Implementation of the output of the state between the ends of the steps.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DenseOutput.h"
+#include "Integrator.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+
+PRIVATE int compare_epochs( const void *left, const void *right )
+{
+    double a = *(const double *)left;
+    double b = *(const double *)right;
+
+    return ( a < b ) ? -1 : ( a > b );
+}
+
+
+PUBLIC int DenseOutput_initialize( DenseOutput *self, const char *path )
+{
+    FILE  *input;
+    double epoch;
+    int    capacity = 0;
+
+    memset( self, 0, sizeof(DenseOutput) );
+    if( path[0] == '\0' ) return 0;
+    if( ( input = fopen( path, "r" ) ) == NULL ) return -1;
+
+    while( fscanf( input, "%lf", &epoch ) == 1 ) {
+        if( self->count == capacity ) {
+            int     new_capacity = ( capacity > 0 ) ? 2 * capacity : 64;
+            double *new_epochs   =
+                (double *)realloc( self->epochs, new_capacity * sizeof(double) );
+
+            if( new_epochs == NULL ) break;
+            self->epochs = new_epochs;
+            capacity     = new_capacity;
+        }
+        self->epochs[self->count++] = epoch;
+    }
+
+    // Anything but white space and numbers to the end of the file is an error.
+    int complete = feof( input ) && !ferror( input );
+    fclose( input );
+    if( !complete ) {
+        DenseOutput_destroy( self );
+        return -1;
+    }
+    qsort( self->epochs, self->count, sizeof(double), compare_epochs );
+
+    size_t state_size = OBJECT_COUNT * sizeof(ObjectDynamics);
+
+    self->start               = (ObjectDynamics *)malloc( state_size );
+    self->interpolated        = (ObjectDynamics *)malloc( state_size );
+    self->start_accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    self->start_jerks         = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    if( self->start == NULL || self->interpolated == NULL ||
+        self->start_accelerations == NULL || self->start_jerks == NULL ) {
+        DenseOutput_destroy( self );
+        return -1;
+    }
+
+    // Epochs before the start can never be output.
+    while( self->next < self->count && self->epochs[self->next] < 0.0 ) ++self->next;
+    return 0;
+}
+
+
+PUBLIC void DenseOutput_destroy( DenseOutput *self )
+{
+    // It is safe to pass NULL to free( ).
+    free( self->epochs );
+    free( self->start );
+    free( self->start_accelerations );
+    free( self->start_jerks );
+    free( self->interpolated );
+
+    // Put the left over object into a well defined state.
+    memset( self, 0, sizeof(DenseOutput) );
+}
+
+
+PUBLIC void DenseOutput_begin_step( DenseOutput *self )
+{
+    const Vector3 *accelerations;
+    const Vector3 *jerks;
+
+    if( self->next == self->count ) return;
+
+    memcpy( self->start, current_dynamics, OBJECT_COUNT * sizeof(ObjectDynamics) );
+    self->start_derivatives = Integrator_derivatives( &accelerations, &jerks );
+    if( self->start_derivatives ) {
+        memcpy( self->start_accelerations, accelerations, OBJECT_COUNT * sizeof(Vector3) );
+        memcpy( self->start_jerks, jerks, OBJECT_COUNT * sizeof(Vector3) );
+    }
+}
+
+
+//! Return the cubic through y0 and y1 with derivatives d0 and d1 at 'fraction' of the step 'h'.
+PRIVATE Vector3 cubic(
+    Vector3 y0, Vector3 d0, Vector3 y1, Vector3 d1, double h, double fraction )
+{
+    double s  = fraction;
+    double s2 = s * s;
+    double s3 = s2 * s;
+
+    return v3_add(
+        v3_add( v3_multiply( 2.0 * s3 - 3.0 * s2 + 1.0, y0 ),
+                v3_multiply( h * ( s3 - 2.0 * s2 + s ), d0 ) ),
+        v3_add( v3_multiply( 3.0 * s2 - 2.0 * s3, y1 ),
+                v3_multiply( h * ( s3 - s2 ), d1 ) ) );
+}
+
+
+//! Return the derivative of the cubic above.
+PRIVATE Vector3 cubic_derivative(
+    Vector3 y0, Vector3 d0, Vector3 y1, Vector3 d1, double h, double fraction )
+{
+    double s  = fraction;
+    double s2 = s * s;
+
+    return v3_add(
+        v3_multiply( ( 6.0 * s2 - 6.0 * s ) / h, v3_subtract( y0, y1 ) ),
+        v3_add( v3_multiply( 3.0 * s2 - 4.0 * s + 1.0, d0 ),
+                v3_multiply( 3.0 * s2 - 2.0 * s, d1 ) ) );
+}
+
+
+//! Return the quintic through y0 and y1 with first derivatives d0 and d1 and second derivatives
+//! c0 and c1 at 'fraction' of the step 'h'.
+PRIVATE Vector3 quintic( Vector3 y0, Vector3 d0, Vector3 c0,
+                         Vector3 y1, Vector3 d1, Vector3 c1, double h, double fraction )
+{
+    double s  = fraction;
+    double s2 = s * s;
+    double s3 = s2 * s;
+    double s4 = s3 * s;
+    double s5 = s4 * s;
+    double h2 = h * h;
+
+    Vector3 start = v3_add(
+        v3_multiply( 1.0 - 10.0 * s3 + 15.0 * s4 - 6.0 * s5, y0 ),
+        v3_add( v3_multiply( h * ( s - 6.0 * s3 + 8.0 * s4 - 3.0 * s5 ), d0 ),
+                v3_multiply( h2 * 0.5 * ( s2 - 3.0 * s3 + 3.0 * s4 - s5 ), c0 ) ) );
+    Vector3 end = v3_add(
+        v3_multiply( 10.0 * s3 - 15.0 * s4 + 6.0 * s5, y1 ),
+        v3_add( v3_multiply( h * ( -4.0 * s3 + 7.0 * s4 - 3.0 * s5 ), d1 ),
+                v3_multiply( h2 * 0.5 * ( s3 - 2.0 * s4 + s5 ), c1 ) ) );
+    return v3_add( start, end );
+}
+
+
+//! Interpolate the state at 'fraction' of the step 'h' into self->interpolated.
+PRIVATE void interpolate( DenseOutput *self, double h, double fraction )
+{
+    const Vector3 *accelerations;
+    const Vector3 *jerks;
+    int            derivatives = self->start_derivatives &&
+                                 Integrator_derivatives( &accelerations, &jerks );
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        const ObjectDynamics *start = &self->start[object_i];
+        const ObjectDynamics *end   = &current_dynamics[object_i];
+        ObjectDynamics       *state = &self->interpolated[object_i];
+
+        if( derivatives ) {
+            Vector3 a0 = self->start_accelerations[object_i], a1 = accelerations[object_i];
+            Vector3 j0 = self->start_jerks[object_i],         j1 = jerks[object_i];
+
+            state->position = quintic( start->position, start->velocity, a0,
+                                       end->position,   end->velocity,   a1, h, fraction );
+            state->velocity = quintic( start->velocity, a0, j0,
+                                       end->velocity,   a1, j1, h, fraction );
+        }
+        else {
+            state->position = cubic( start->position, start->velocity,
+                                     end->position,   end->velocity, h, fraction );
+            state->velocity = cubic_derivative( start->position, start->velocity,
+                                                end->position,   end->velocity, h, fraction );
+        }
+    }
+}
+
+
+PUBLIC void DenseOutput_end_step( DenseOutput *self, double time_step )
+{
+    double start_time = self->time;
+
+    self->time += time_step;
+    while( self->next < self->count && self->epochs[self->next] <= self->time ) {
+        double          epoch = self->epochs[self->next++];
+        ObjectDynamics *saved = current_dynamics;
+
+        interpolate( self, time_step, ( epoch - start_time ) / time_step );
+
+        // The interpolated state is printed as the current state is.
+        current_dynamics = self->interpolated;
+        printf( "\nEPOCH %.6E seconds position\n", epoch );
+        dump_dynamics( );
+        current_dynamics = saved;
+    }
+}
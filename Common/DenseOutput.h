@@ -0,0 +1,75 @@
+/*! \file    DenseOutput.h
+ *  \brief   Output of the state at chosen times between the ends of the steps.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The state of the system is often wanted at particular times (epochs), such as the times of
+ * observations, that are not the ends of steps. Shortening the steps to land on them makes the
+ * whole simulation slower. Instead the state at the start of each step containing an epoch is
+ * kept and the state at the epoch is interpolated between the two ends of the step.
+ *
+ * In general the positions are interpolated with the cubic in time that matches the positions
+ * and velocities at both ends, and the velocities are its derivative. The error of the cubic is
+ * of the fourth order in the step; no worse than that of the leapfrog and Euler methods
+ * themselves. When the Hermite method supplies the accelerations and jerks at both ends (see
+ * Integrator_derivatives) the positions are interpolated with the quintic that also matches the
+ * accelerations and the velocities with the quintic that matches the velocities, accelerations,
+ * and jerks. No forces are computed for the interpolation.
+ *
+ * The block method's velocities are not all of the same time between steps so the velocities
+ * it leaves do not suit the interpolation; epochs are then only as accurate as the positions.
+ */
+
+#ifndef DENSEOUTPUT_H
+#define DENSEOUTPUT_H
+
+#include "global.h"
+
+//! Structure that holds the epochs still to be output and the state at the start of a step.
+typedef struct {
+    double         *epochs;              //!< Seconds from the start, in increasing order.
+    int             count;               //!< Number of epochs.
+    int             next;                //!< Index of the next epoch to output.
+    double          time;                //!< Seconds from the start to current_dynamics.
+    ObjectDynamics *start;               //!< The state at the start of the step.
+    Vector3        *start_accelerations; //!< The Hermite method's accelerations at the start.
+    Vector3        *start_jerks;         //!< The Hermite method's jerks at the start.
+    int             start_derivatives;   //!< Nonzero if the two arrays above are known.
+    ObjectDynamics *interpolated;        //!< The state at an epoch.
+} DenseOutput;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Read the epochs from the file named 'path'.
+/*!
+ * The file holds times in seconds from the start of the simulation separated by white space.
+ * They need not be in order. If 'path' is empty there are no epochs and the other functions
+ * do nothing.
+ *
+ * \return Zero if successful or -1 if the file could not be read or memory allocated.
+ */
+int DenseOutput_initialize( DenseOutput *self, const char *path );
+
+//! Release the memory held by the object.
+void DenseOutput_destroy( DenseOutput *self );
+
+//! Remember current_dynamics as the state at the start of the next step.
+/*!
+ * This must be called just before each step. Nothing is remembered if no epochs remain.
+ */
+void DenseOutput_begin_step( DenseOutput *self );
+
+//! Print the state at each epoch in the step of 'time_step' seconds just taken.
+/*!
+ * This must be called just after each step. For each epoch in the step, its time is printed
+ * followed by the interpolated state in the format of dump_dynamics (which is used to print
+ * it).
+ */
+void DenseOutput_end_step( DenseOutput *self, double time_step );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
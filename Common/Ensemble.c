@@ -0,0 +1,116 @@
+/*! \file    Ensemble.c
+ *  \brief   Implementation of the storage for ensembles of simulations.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "Ensemble.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+#define CACHE_LINE_SIZE 64
+
+//! Allocate a zero filled, cache line aligned array of 'count' doubles.
+PRIVATE double *allocate_array( int count )
+{
+    void *result;
+
+    if( posix_memalign( &result, CACHE_LINE_SIZE, count * sizeof(double) ) != 0 ) return NULL;
+    memset( result, 0, count * sizeof(double) );
+    return (double *)result;
+}
+
+
+PUBLIC int Ensemble_initialize( Ensemble *self, int count, int simulation_count )
+{
+    int group_count = ( simulation_count + ENSEMBLE_LANES - 1 ) / ENSEMBLE_LANES;
+    int size        = group_count * count * ENSEMBLE_LANES;
+
+    self->count            = count;
+    self->simulation_count = simulation_count;
+    self->group_count      = group_count;
+    self->x  = allocate_array( size );
+    self->y  = allocate_array( size );
+    self->z  = allocate_array( size );
+    self->vx = allocate_array( size );
+    self->vy = allocate_array( size );
+    self->vz = allocate_array( size );
+    self->mu = allocate_array( size );
+    self->ax = allocate_array( size );
+    self->ay = allocate_array( size );
+    self->az = allocate_array( size );
+
+    if( self->x  == NULL || self->y  == NULL || self->z  == NULL ||
+        self->vx == NULL || self->vy == NULL || self->vz == NULL || self->mu == NULL ||
+        self->ax == NULL || self->ay == NULL || self->az == NULL ) {
+        Ensemble_destroy( self );
+        return -1;
+    }
+    return 0;
+}
+
+
+PUBLIC void Ensemble_destroy( Ensemble *self )
+{
+    // It is safe to pass NULL to free( ).
+    free( self->x  ); free( self->y  ); free( self->z  );
+    free( self->vx ); free( self->vy ); free( self->vz );
+    free( self->mu );
+    free( self->ax ); free( self->ay ); free( self->az );
+
+    // Put the left over ensemble into a well defined state.
+    memset( self, 0, sizeof(Ensemble) );
+}
+
+
+PUBLIC void Ensemble_load(
+    Ensemble *self, int simulation, const Object *objects, const ObjectDynamics *dynamics )
+{
+    for( int i = 0; i < self->count; ++i ) {
+        int index = Ensemble_index( self, simulation, i );
+
+        self->x[index]  = dynamics[i].position.x;
+        self->y[index]  = dynamics[i].position.y;
+        self->z[index]  = dynamics[i].position.z;
+        self->vx[index] = dynamics[i].velocity.x;
+        self->vy[index] = dynamics[i].velocity.y;
+        self->vz[index] = dynamics[i].velocity.z;
+        self->mu[index] = objects[i].mu;
+    }
+}
+
+
+PUBLIC void Ensemble_store( const Ensemble *self, int simulation, ObjectDynamics *dynamics )
+{
+    for( int i = 0; i < self->count; ++i ) {
+        int index = Ensemble_index( self, simulation, i );
+
+        dynamics[i].position.x = self->x[index];
+        dynamics[i].position.y = self->y[index];
+        dynamics[i].position.z = self->z[index];
+        dynamics[i].velocity.x = self->vx[index];
+        dynamics[i].velocity.y = self->vy[index];
+        dynamics[i].velocity.z = self->vz[index];
+    }
+}
+
+
+// The lanes of every body are independent, so the whole arrays are processed as flat vectors.
+PUBLIC void Ensemble_advance( Ensemble *self, double time_step )
+{
+    int size = self->group_count * self->count * ENSEMBLE_LANES;
+    double *restrict x  = self->x,  *restrict y  = self->y,  *restrict z  = self->z;
+    double *restrict vx = self->vx, *restrict vy = self->vy, *restrict vz = self->vz;
+    const double *restrict ax = self->ax, *restrict ay = self->ay, *restrict az = self->az;
+
+    for( int i = 0; i < size; ++i ) {
+        x[i]  += time_step * vx[i];
+        y[i]  += time_step * vy[i];
+        z[i]  += time_step * vz[i];
+        vx[i] += time_step * ax[i];
+        vy[i] += time_step * ay[i];
+        vz[i] += time_step * az[i];
+    }
+}
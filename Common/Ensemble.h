@@ -0,0 +1,79 @@
+/*! \file    Ensemble.h
+ *  \brief   Storage for many independent copies of a simulation advanced in lock-step.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * Vectorizing the force computation over the bodies of a simulation gains little when there
+ * are only a few bodies. Monte Carlo studies, however, run many copies of the same system with
+ * slightly different initial conditions. An Ensemble holds such copies so that each lane of a
+ * vector register works on a different simulation. The copies are arranged in groups of
+ * ENSEMBLE_LANES simulations and, within a group, each array is indexed by [body][lane]. Body i
+ * of all the simulations in a group is thus one aligned vector, and the kernels do the same
+ * arithmetic for every lane with no shuffling or masking.
+ *
+ * The simulations of an ensemble must have the same number of bodies. Their positions,
+ * velocities, and gravitational parameters can differ freely.
+ */
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "global.h"
+
+//! The number of simulations in a group. This is the width of an AVX-512 register.
+#define ENSEMBLE_LANES 8
+
+//! Structure that holds the state of an ensemble of simulations.
+typedef struct {
+    int     count;              //!< Number of bodies in each simulation.
+    int     simulation_count;   //!< Number of simulations requested.
+    int     group_count;        //!< Number of groups of ENSEMBLE_LANES simulations.
+    double *x,  *y,  *z;        //!< Positions.
+    double *vx, *vy, *vz;       //!< Velocities.
+    double *mu;                 //!< Gravitational parameters (G times the mass).
+    double *ax, *ay, *az;       //!< Accelerations (written by AllPairs_ensemble).
+} Ensemble;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Allocate the arrays for 'simulation_count' simulations of 'count' bodies each.
+/*!
+ * The number of simulations is rounded up to a whole number of groups. All elements are
+ * initialized to zero; the extra simulations should be loaded (for example with copies of
+ * another simulation) before the ensemble is advanced.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int Ensemble_initialize( Ensemble *self, int count, int simulation_count );
+
+//! Release the memory held by the ensemble.
+void Ensemble_destroy( Ensemble *self );
+
+//! Copy the state of a simulation into the ensemble as simulation number 'simulation'.
+void Ensemble_load(
+    Ensemble *self, int simulation, const Object *objects, const ObjectDynamics *dynamics );
+
+//! Copy the positions and velocities of simulation number 'simulation' out of the ensemble.
+void Ensemble_store( const Ensemble *self, int simulation, ObjectDynamics *dynamics );
+
+//! Take one Euler step of 'time_step' seconds using the accelerations in the ensemble.
+/*!
+ * The positions are advanced with the old velocities, as in the Serial program, and the
+ * velocities with the accelerations.
+ */
+void Ensemble_advance( Ensemble *self, double time_step );
+
+//! Return the index in the ensemble's arrays of a body of a simulation.
+static inline int Ensemble_index( const Ensemble *self, int simulation, int body )
+{
+    int group = simulation / ENSEMBLE_LANES;
+    int lane  = simulation % ENSEMBLE_LANES;
+    return ( group * self->count + body ) * ENSEMBLE_LANES + lane;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,353 @@
+/*! \file    IAS15.c
+ *  \brief   Implementation of the adaptive 15th order Gauss-Radau integrator.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The notation follows Rein and Spiegel (2015). Over a step of length dt the acceleration is
+ *
+ *     a(h) = a0 + b0 h + b1 h^2 + ... + b6 h^7,    h in [0, 1],
+ *
+ * and the same polynomial is written in Newton form, a0 + g0 h + g1 h (h - h1) + ..., on the
+ * Gauss-Radau spacings h1 through h7. The g are divided differences of the accelerations at the
+ * spacings so they are easy to correct one at a time; the b are easy to integrate.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IAS15.h"
+#include "Options.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+// The number of components (three per object) in each of the integrator's arrays.
+#define COMPONENTS ( 3 * OBJECT_COUNT )
+
+// The predictor-corrector iteration stops when the last coefficient changes by less than this
+// fraction of the accelerations, when the changes stop decreasing, or after MAXIMUM_ITERATIONS.
+#define CONVERGED 1.0E-16
+#define MAXIMUM_ITERATIONS 12
+
+// A step is redone if the error estimate calls for a step smaller than this fraction of it. The
+// next step is never more than the inverse of this fraction longer than the last.
+#define SAFETY_FACTOR 0.25
+
+// The Gauss-Radau spacings: the zero and the roots of the Radau polynomial of degree seven.
+PRIVATE const double spacing[8] = {
+    0.0,
+    0.0562625605369221464656521910318,
+    0.180240691736892364987579942780,
+    0.352624717113169637373907769648,
+    0.547153626330555383001448554766,
+    0.734210177215410531523210605558,
+    0.885320946839095768090359771030,
+    0.977520613561287501891174488626
+};
+
+// to_power[j][k] is the coefficient of h^k in (h - h1)(h - h2)...(h - hj). Then b_k is the sum
+// over j >= k of to_power[j][k] * g_j. It is computed from the spacings on first use.
+PRIVATE double to_power[7][7];
+
+// The state at the start of the step (with the compensation terms of the Kahan sums), the
+// accelerations there and at the current substep, and the coefficients. The e are the values
+// the b were predicted to have; the saved copies are those of the last completed step.
+PRIVATE double *x0, *v0, *a0, *at, *x_compensation, *v_compensation;
+PRIVATE double *g[7], *b[7], *e[7], *saved_b[7], *saved_e[7];
+
+// The state at a substep as the acceleration function wants it.
+PRIVATE ObjectDynamics *substep_dynamics;
+PRIVATE Vector3        *substep_accelerations;
+
+PRIVATE int    started      = 0;    // Nonzero once x0 and v0 hold the state.
+PRIVATE double next_step    = 0.0;  // Length of the next step (zero if not yet known).
+PRIVATE double last_step    = 0.0;  // Length of the last completed step (zero if none).
+
+
+//! Allocate the arrays and compute to_power if that has not been done already.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int reserve( void )
+{
+    double *block;
+
+    if( x0 != NULL ) return 0;
+
+    // Six state arrays and five sets of seven coefficient arrays.
+    block = (double *)calloc( ( 6 + 5 * 7 ) * (size_t)COMPONENTS, sizeof(double) );
+    substep_dynamics = (ObjectDynamics *)malloc( OBJECT_COUNT * sizeof(ObjectDynamics) );
+    substep_accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    if( block == NULL || substep_dynamics == NULL || substep_accelerations == NULL ) {
+        free( block ); free( substep_dynamics ); free( substep_accelerations );
+        substep_dynamics = NULL;
+        substep_accelerations = NULL;
+        return -1;
+    }
+    x0 = block;
+    v0 = x0 + COMPONENTS;
+    a0 = v0 + COMPONENTS;
+    at = a0 + COMPONENTS;
+    x_compensation = at + COMPONENTS;
+    v_compensation = x_compensation + COMPONENTS;
+    for( int k = 0; k < 7; ++k ) {
+        g[k]       = v_compensation + ( 1 + k ) * COMPONENTS;
+        b[k]       = g[k] + 7 * COMPONENTS;
+        e[k]       = b[k] + 7 * COMPONENTS;
+        saved_b[k] = e[k] + 7 * COMPONENTS;
+        saved_e[k] = saved_b[k] + 7 * COMPONENTS;
+    }
+
+    // Multiply out the products one factor at a time.
+    to_power[0][0] = 1.0;
+    for( int j = 1; j < 7; ++j ) {
+        for( int k = 0; k <= j; ++k ) {
+            double shifted = ( k > 0 ) ? to_power[j - 1][k - 1] : 0.0;
+            double kept    = ( k < j ) ? to_power[j - 1][k] : 0.0;
+            to_power[j][k] = shifted - spacing[j] * kept;
+        }
+    }
+    return 0;
+}
+
+
+//! Compute the accelerations of the state at fraction 'h' of a step of 'dt' into 'result'.
+PRIVATE void evaluate( AccelerationFunction compute_accelerations,
+                       double h, double dt, double *result )
+{
+    double s = h * dt;
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        double position[3], velocity[3];
+
+        for( int c = 0; c < 3; ++c ) {
+            int k = 3 * object_i + c;
+
+            position[c] = x0[k] + s * ( v0[k] + s * ( a0[k] / 2.0 + h * ( b[0][k] / 6.0 +
+                h * ( b[1][k] / 12.0 + h * ( b[2][k] / 20.0 + h * ( b[3][k] / 30.0 +
+                h * ( b[4][k] / 42.0 + h * ( b[5][k] / 56.0 +
+                h * b[6][k] / 72.0 ) ) ) ) ) ) ) );
+            velocity[c] = v0[k] + s * ( a0[k] + h * ( b[0][k] / 2.0 + h * ( b[1][k] / 3.0 +
+                h * ( b[2][k] / 4.0 + h * ( b[3][k] / 5.0 + h * ( b[4][k] / 6.0 +
+                h * ( b[5][k] / 7.0 + h * b[6][k] / 8.0 ) ) ) ) ) ) );
+        }
+        substep_dynamics[object_i].position.x = position[0];
+        substep_dynamics[object_i].position.y = position[1];
+        substep_dynamics[object_i].position.z = position[2];
+        substep_dynamics[object_i].velocity.x = velocity[0];
+        substep_dynamics[object_i].velocity.y = velocity[1];
+        substep_dynamics[object_i].velocity.z = velocity[2];
+    }
+
+    compute_accelerations( substep_dynamics, substep_accelerations, NULL );
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        result[3 * object_i]     = substep_accelerations[object_i].x;
+        result[3 * object_i + 1] = substep_accelerations[object_i].y;
+        result[3 * object_i + 2] = substep_accelerations[object_i].z;
+    }
+}
+
+
+//! Predict b and e for a step of 'dt' by extrapolating the polynomial of the last step.
+/*!
+ * The new b are the extrapolation corrected by the error in the prediction of the last step
+ * (saved b - saved e). The new e are the extrapolation alone.
+ */
+PRIVATE void predict( double dt )
+{
+    double ratio = ( last_step != 0.0 ) ? dt / last_step : 0.0;
+    double q[8];
+
+    // Without a last step, or with one much shorter, the iteration starts from zero instead.
+    if( ratio == 0.0 || ratio > 20.0 ) {
+        for( int j = 0; j < 7; ++j ) {
+            memset( b[j], 0, COMPONENTS * sizeof(double) );
+            memset( e[j], 0, COMPONENTS * sizeof(double) );
+        }
+        return;
+    }
+
+    q[0] = 1.0;
+    for( int j = 1; j < 8; ++j ) q[j] = q[j - 1] * ratio;
+
+    // The coefficient of h^(j + 1) in a(1 + ratio * h) is a sum of binomial multiples.
+    for( int k = 0; k < COMPONENTS; ++k ) {
+        for( int j = 0; j < 7; ++j ) {
+            double sum      = 0.0;
+            double binomial = 1.0;   // (m + 1) choose (j + 1), starting with m = j.
+
+            for( int m = j; m < 7; ++m ) {
+                sum += binomial * saved_b[m][k];
+                binomial = binomial * ( m + 2 ) / ( m + 1 - j );
+            }
+            e[j][k] = q[j + 1] * sum;
+            b[j][k] = e[j][k] + ( saved_b[j][k] - saved_e[j][k] );
+        }
+    }
+}
+
+
+//! Add 'value' to '*sum' using Kahan summation with the compensation term '*compensation'.
+PRIVATE void add_compensated( double *sum, double *compensation, double value )
+{
+    double y = value - *compensation;
+    double t = *sum + y;
+
+    *compensation = ( t - *sum ) - y;
+    *sum = t;
+}
+
+
+//! Try to take a step of 'dt'. The accelerations at the start must be in a0.
+/*!
+ * The predicted coefficients must be in b and e.
+ *
+ * \return The length of the step to take next. If it is less than SAFETY_FACTOR * dt the step
+ * was rejected and x0 and v0 are unchanged.
+ */
+PRIVATE double attempt( AccelerationFunction compute_accelerations, double dt )
+{
+    double error      = 1.0E300;
+    double last_error = 2.0;
+    int    iterations = 0;
+    double maximum_a  = 0.0;
+    double maximum_b6 = 0.0;
+    double new_step;
+
+    // Put the predicted coefficients into Newton form.
+    for( int k = 0; k < COMPONENTS; ++k ) {
+        for( int j = 6; j >= 0; --j ) {
+            double value = b[j][k];
+            for( int m = j + 1; m < 7; ++m ) value -= to_power[m][j] * g[m][k];
+            g[j][k] = value;
+        }
+    }
+
+    while( error >= CONVERGED &&
+           !( iterations > 2 && last_error <= error ) && iterations < MAXIMUM_ITERATIONS ) {
+        last_error = error;
+        ++iterations;
+        for( int n = 1; n < 8; ++n ) {
+            double maximum_change = 0.0;
+
+            evaluate( compute_accelerations, spacing[n], dt, at );
+            maximum_a = 0.0;
+            for( int k = 0; k < COMPONENTS; ++k ) {
+                double value = ( at[k] - a0[k] ) / spacing[n];
+                double change;
+
+                for( int m = 0; m < n - 1; ++m ) {
+                    value = ( value - g[m][k] ) / ( spacing[n] - spacing[m + 1] );
+                }
+                change = value - g[n - 1][k];
+                g[n - 1][k] = value;
+                for( int m = 0; m < n; ++m ) b[m][k] += to_power[n - 1][m] * change;
+
+                if( fabs( change ) > maximum_change ) maximum_change = fabs( change );
+                if( fabs( at[k] ) > maximum_a ) maximum_a = fabs( at[k] );
+            }
+            if( n == 7 ) error = ( maximum_a > 0.0 ) ? maximum_change / maximum_a : 0.0;
+        }
+    }
+
+    // The last coefficient estimates the error of the step. The step is scaled to bring it to
+    // options.ias15_epsilon.
+    for( int k = 0; k < COMPONENTS; ++k ) {
+        if( fabs( b[6][k] ) > maximum_b6 ) maximum_b6 = fabs( b[6][k] );
+    }
+    if( options.ias15_epsilon == 0.0 )
+        new_step = dt;
+    else if( maximum_a > 0.0 && maximum_b6 > 0.0 )
+        new_step = dt * pow( options.ias15_epsilon * maximum_a / maximum_b6, 1.0 / 7.0 );
+    else
+        new_step = dt / SAFETY_FACTOR;
+
+    if( new_step < SAFETY_FACTOR * dt ) return new_step;
+    if( new_step > dt / SAFETY_FACTOR ) new_step = dt / SAFETY_FACTOR;
+
+    // Integrate the polynomial over the whole step.
+    for( int k = 0; k < COMPONENTS; ++k ) {
+        double dx = dt * v0[k] + dt * dt * ( a0[k] / 2.0 + b[0][k] / 6.0 +
+            b[1][k] / 12.0 + b[2][k] / 20.0 + b[3][k] / 30.0 + b[4][k] / 42.0 +
+            b[5][k] / 56.0 + b[6][k] / 72.0 );
+        double dv = dt * ( a0[k] + b[0][k] / 2.0 + b[1][k] / 3.0 + b[2][k] / 4.0 +
+            b[3][k] / 5.0 + b[4][k] / 6.0 + b[5][k] / 7.0 + b[6][k] / 8.0 );
+
+        add_compensated( &x0[k], &x_compensation[k], dx );
+        add_compensated( &v0[k], &v_compensation[k], dv );
+    }
+
+    last_step = dt;
+    for( int j = 0; j < 7; ++j ) {
+        memcpy( saved_b[j], b[j], COMPONENTS * sizeof(double) );
+        memcpy( saved_e[j], e[j], COMPONENTS * sizeof(double) );
+    }
+    return new_step;
+}
+
+
+PUBLIC int IAS15_advance( AccelerationFunction compute_accelerations, double time )
+{
+    double remaining = time;
+
+    if( reserve( ) != 0 ) return -1;
+
+    if( !started ) {
+        for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+            x0[3 * object_i]     = current_dynamics[object_i].position.x;
+            x0[3 * object_i + 1] = current_dynamics[object_i].position.y;
+            x0[3 * object_i + 2] = current_dynamics[object_i].position.z;
+            v0[3 * object_i]     = current_dynamics[object_i].velocity.x;
+            v0[3 * object_i + 1] = current_dynamics[object_i].velocity.y;
+            v0[3 * object_i + 2] = current_dynamics[object_i].velocity.z;
+        }
+        started = 1;
+    }
+    if( next_step == 0.0 ) next_step = time;
+
+    while( remaining > 0.0 ) {
+        double wanted = next_step;
+        double dt     = ( next_step < remaining ) ? next_step : remaining;
+        double proposed;
+
+        // The accelerations at the start. A rejected step is retried from the same place.
+        evaluate( compute_accelerations, 0.0, 0.0, a0 );
+        while( 1 ) {
+            predict( dt );
+            proposed = attempt( compute_accelerations, dt );
+            if( proposed >= SAFETY_FACTOR * dt ) break;
+            wanted = proposed;
+            dt     = ( proposed < remaining ) ? proposed : remaining;
+        }
+        remaining -= dt;
+
+        // A step shortened to end at the requested time says little about the step size.
+        next_step = proposed;
+        if( dt < wanted && proposed > dt && wanted > proposed ) next_step = wanted;
+    }
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        current_dynamics[object_i].position.x = x0[3 * object_i];
+        current_dynamics[object_i].position.y = x0[3 * object_i + 1];
+        current_dynamics[object_i].position.z = x0[3 * object_i + 2];
+        current_dynamics[object_i].velocity.x = v0[3 * object_i];
+        current_dynamics[object_i].velocity.y = v0[3 * object_i + 1];
+        current_dynamics[object_i].velocity.z = v0[3 * object_i + 2];
+    }
+    return 0;
+}
+
+
+PUBLIC void IAS15_reset( void )
+{
+    started      = 0;
+    next_step    = 0.0;
+    last_step    = 0.0;
+    if( x0 == NULL ) return;
+
+    memset( x_compensation, 0, COMPONENTS * sizeof(double) );
+    memset( v_compensation, 0, COMPONENTS * sizeof(double) );
+    for( int j = 0; j < 7; ++j ) {
+        memset( b[j], 0, COMPONENTS * sizeof(double) );
+        memset( e[j], 0, COMPONENTS * sizeof(double) );
+    }
+}
@@ -0,0 +1,47 @@
+/*! \file    IAS15.h
+ *  \brief   Interface to the adaptive 15th order Gauss-Radau integrator.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * This is the IAS15 integrator of Rein and Spiegel (2015, MNRAS 446, 1424), which is in turn
+ * based on Everhart's RADAU. The accelerations over a step are approximated by a polynomial of
+ * degree seven in time whose coefficients are found by a predictor-corrector iteration using
+ * the accelerations at the eight Gauss-Radau points of the step. The positions and velocities
+ * are advanced by integrating the polynomial. The size of the next step is chosen from the
+ * highest order coefficient so that the error of each step stays below the rounding error of
+ * the positions. Sums over many steps are compensated (Kahan summation) for the same reason.
+ *
+ * The method is meant for small systems followed with high precision over long times. Each
+ * step costs from eight to more than seventy force evaluations but the steps are long and the
+ * result is as accurate as double precision allows.
+ */
+
+#ifndef IAS15_H
+#define IAS15_H
+
+#include "Integrator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Advance current_dynamics by 'time' seconds using as many adaptive steps as needed.
+/*!
+ * The step size is kept from one call to the next. The last step of a call is shortened to
+ * end exactly at the requested time. The relative accuracy of each step is set by
+ * options.ias15_epsilon. If it is zero every step is 'time' seconds long.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int IAS15_advance( AccelerationFunction compute_accelerations, double time );
+
+//! Forget the step size and the polynomial predicted for the next step.
+/*!
+ * This must be called if current_dynamics is changed other than by IAS15_advance.
+ */
+void IAS15_reset( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,8 +3,11 @@
  *  \author  Peter Chapin <spicacality@kelseymountain.org>
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include "global.h"
+#include "AllPairs.h"
+#include "BodyStore.h"
 #include "Initialize.h"
 
 // The global arrays used to hold the object data.
@@ -12,6 +15,9 @@ Object *object_array;
 ObjectDynamics *current_dynamics;
 ObjectDynamics *next_dynamics;
 
+// The structure-of-arrays copy of the object data used by the force kernels.
+BodyStore body_store;
+
 //! Return a random coordinate inside a 100.0 AU cube about the origin.
 static double random_position_coordinate( )
 {
@@ -50,6 +56,10 @@ void initialize_object_arrays( )
         object_array[i].mass = 5.9722E+24;   // Mass of the Earth.
     }
 
+    for( int i = 0; i < OBJECT_COUNT; ++i ) {
+        object_array[i].mu = G * object_array[i].mass;
+    }
+
     A = (ObjectDynamics *)malloc(OBJECT_COUNT * sizeof(ObjectDynamics));
     B = (ObjectDynamics *)malloc(OBJECT_COUNT * sizeof(ObjectDynamics));
 
@@ -78,4 +88,12 @@ void initialize_object_arrays( )
     }
     current_dynamics = A;
     next_dynamics = B;
+
+    // Set up the force kernels. The masses never change so they are loaded only once.
+    AllPairs_initialize( );
+    if( BodyStore_initialize( &body_store, OBJECT_COUNT ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the body store\n" );
+        exit( EXIT_FAILURE );
+    }
+    BodyStore_load_parameters( &body_store, object_array );
 }
@@ -0,0 +1,865 @@
+/*! \file    Integrator.c
+ *  \brief   Implementation of the methods of advancing a simulation in time.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IAS15.h"
+#include "Integrator.h"
+#include "Kepler.h"
+#include "NeighborList.h"
+#include "Options.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+// The accelerations (and, for the Hermite method, jerks) of the objects in current_dynamics.
+PRIVATE Vector3 *accelerations;
+PRIVATE Vector3 *jerks;
+PRIVATE int      accelerations_valid = 0;
+
+// The step level of each object and the list of objects being kicked for the block method.
+// The step of an object on level k is 2^k base steps.
+PRIVATE int       *levels;
+PRIVATE int       *active;
+PRIVATE long long  base_steps;
+
+// The heliocentric positions and barycentric velocities of the Wisdom-Holman method, in
+// component arrays for the Kepler solver, and the same state as a dynamics array for the
+// acceleration function. They are allocated on first use.
+PRIVATE double         *helio_x,  *helio_y,  *helio_z;
+PRIVATE double         *helio_vx, *helio_vy, *helio_vz;
+PRIVATE ObjectDynamics *heliocentric;
+
+// The accelerations at the start of the last step chosen by Integrator_choose_step and that
+// step's length (zero if there is none). Their change over the step estimates the jerks.
+PRIVATE Vector3 *previous_accelerations;
+PRIVATE double   previous_step = 0.0;
+
+// The near objects of the RESPA and encounter methods and the accelerations due to them. The
+// accelerations array holds the rest (the far accelerations) for those methods.
+PRIVATE NeighborList near_list;
+PRIVATE Vector3     *near_accelerations;
+
+// The objects of the encounter method with near neighbors, followed by those without.
+PRIVATE int *encounter_order;
+
+// Work areas for the Hermite method. They are allocated on first use.
+PRIVATE ObjectDynamics *predicted;
+PRIVATE Vector3        *new_accelerations;
+PRIVATE Vector3        *new_jerks;
+
+
+//! Add 'time_step' times the accelerations to the velocities.
+PRIVATE void kick( double time_step )
+{
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        current_dynamics[object_i].velocity = v3_add(
+            current_dynamics[object_i].velocity,
+            v3_multiply( time_step, accelerations[object_i] ) );
+    }
+}
+
+
+//! Add 'time_step' times the velocities to the positions.
+PRIVATE void drift( double time_step )
+{
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        current_dynamics[object_i].position = v3_add(
+            current_dynamics[object_i].position,
+            v3_multiply( time_step, current_dynamics[object_i].velocity ) );
+    }
+}
+
+
+// The positions are advanced with the old velocities, as in the programs' own Euler steps. The
+// method is first order and its energy error grows steadily, so it needs a small step.
+PRIVATE void euler_step( AccelerationFunction compute_accelerations, double time_step )
+{
+    if( !accelerations_valid ) compute_accelerations( current_dynamics, accelerations, NULL );
+    drift( time_step );
+    kick( time_step );
+    accelerations_valid = 0;
+}
+
+
+// Kick-drift-kick. The method is second order and symplectic, so the energy error stays bounded
+// over long runs. The accelerations at the end of a step are those needed at the start of the
+// next; they are kept so the forces are computed once per step.
+PRIVATE void leapfrog_step( AccelerationFunction compute_accelerations, double time_step )
+{
+    if( !accelerations_valid ) compute_accelerations( current_dynamics, accelerations, NULL );
+    kick( 0.5 * time_step );
+    drift( time_step );
+    compute_accelerations( current_dynamics, accelerations, NULL );
+    kick( 0.5 * time_step );
+    accelerations_valid = 1;
+}
+
+
+// Yoshida's (1990) fourth order composition: leapfrog steps of w1, w0, w1 times the step, with
+// w1 = 1 / (2 - 2^(1/3)) and w0 = 1 - 2 w1.
+PRIVATE const double yoshida4_weights[] = {
+     1.35120719195965763404768780897,
+    -1.70241438391931526809537561794,
+     1.35120719195965763404768780897
+};
+
+// Yoshida's sixth order composition (his solution A): w3, w2, w1, w0, w1, w2, w3.
+PRIVATE const double yoshida6_weights[] = {
+     0.784513610477557263819497633866,
+     0.235573213359358133684793182978,
+    -1.17767998417887100694641568096,
+     1.31518632068391121888424972823,
+    -1.17767998417887100694641568096,
+     0.235573213359358133684793182978,
+     0.784513610477557263819497633866
+};
+
+
+// A symmetric sequence of leapfrog steps whose lengths sum to the step. The errors of the
+// substeps cancel to a higher order; the middle ones are negative or longer than the step. The
+// accelerations at the end of each substep start the next so each costs one force evaluation.
+// The higher order allows a step long enough to pay for the extra evaluations.
+PRIVATE void composition_step( AccelerationFunction compute_accelerations, double time_step,
+                               const double *weights, int count )
+{
+    for( int i = 0; i < count; ++i ) {
+        leapfrog_step( compute_accelerations, weights[i] * time_step );
+    }
+}
+
+
+//! Allocate the Hermite method's arrays if that has not been done already.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int reserve_hermite( void )
+{
+    if( predicted != NULL ) return 0;
+
+    jerks             = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    new_accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    new_jerks         = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    predicted         = (ObjectDynamics *)malloc( OBJECT_COUNT * sizeof(ObjectDynamics) );
+    if( jerks == NULL || new_accelerations == NULL || new_jerks == NULL || predicted == NULL ) {
+        free( jerks ); free( new_accelerations ); free( new_jerks ); free( predicted );
+        jerks = new_accelerations = new_jerks = NULL;
+        predicted = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+
+PUBLIC ObjectDynamics Integrator_hermite_predict(
+    const ObjectDynamics *state, Vector3 acceleration, Vector3 jerk, double time_step )
+{
+    double         h  = time_step;
+    double         h2 = h * h;
+    ObjectDynamics result;
+
+    result.position = v3_add(
+        state->position,
+        v3_add( v3_multiply( h, state->velocity ),
+                v3_add( v3_multiply( h2 / 2.0, acceleration ),
+                        v3_multiply( h2 * h / 6.0, jerk ) ) ) );
+    result.velocity = v3_add(
+        state->velocity,
+        v3_add( v3_multiply( h, acceleration ), v3_multiply( h2 / 2.0, jerk ) ) );
+    return result;
+}
+
+
+PUBLIC void Integrator_hermite_correct( ObjectDynamics *state,
+    Vector3 a0, Vector3 j0, Vector3 a1, Vector3 j1, double time_step )
+{
+    double  h  = time_step;
+    double  h2 = h * h;
+    Vector3 velocity;
+
+    velocity = v3_add(
+        state->velocity,
+        v3_add( v3_multiply( h / 2.0, v3_add( a0, a1 ) ),
+                v3_multiply( h2 / 12.0, v3_subtract( j0, j1 ) ) ) );
+    state->position = v3_add(
+        state->position,
+        v3_add( v3_multiply( h / 2.0, v3_add( state->velocity, velocity ) ),
+                v3_multiply( h2 / 12.0, v3_subtract( a0, a1 ) ) ) );
+    state->velocity = velocity;
+}
+
+
+// Aarseth's formulation: a third order Taylor prediction followed by a correction that makes
+// the step fourth order. The accelerations and jerks at the end are kept for the next step, so
+// the forces are computed once per step, and the error falls sixteen fold when it is halved.
+PRIVATE void hermite_step( AccelerationFunction compute_accelerations, double time_step )
+{
+    if( !accelerations_valid ) compute_accelerations( current_dynamics, accelerations, jerks );
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        predicted[object_i] = Integrator_hermite_predict(
+            &current_dynamics[object_i], accelerations[object_i], jerks[object_i], time_step );
+    }
+
+    compute_accelerations( predicted, new_accelerations, new_jerks );
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        Integrator_hermite_correct( &current_dynamics[object_i],
+            accelerations[object_i], jerks[object_i],
+            new_accelerations[object_i], new_jerks[object_i], time_step );
+    }
+    memcpy( accelerations, new_accelerations, OBJECT_COUNT * sizeof(Vector3) );
+    memcpy( jerks, new_jerks, OBJECT_COUNT * sizeof(Vector3) );
+    accelerations_valid = 1;
+}
+
+
+//! Allocate the Wisdom-Holman method's arrays if that has not been done already.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int reserve_wisdom_holman( void )
+{
+    if( heliocentric != NULL ) return 0;
+
+    helio_x  = (double *)malloc( 6 * OBJECT_COUNT * sizeof(double) );
+    heliocentric = (ObjectDynamics *)malloc( OBJECT_COUNT * sizeof(ObjectDynamics) );
+    if( helio_x == NULL || heliocentric == NULL ) {
+        free( helio_x ); free( heliocentric );
+        helio_x = NULL;
+        heliocentric = NULL;
+        return -1;
+    }
+    helio_y  = helio_x + OBJECT_COUNT;
+    helio_z  = helio_y + OBJECT_COUNT;
+    helio_vx = helio_z + OBJECT_COUNT;
+    helio_vy = helio_vx + OBJECT_COUNT;
+    helio_vz = helio_vy + OBJECT_COUNT;
+    return 0;
+}
+
+
+//! Compute the accelerations of the planets due to each other into 'accelerations'.
+/*!
+ * The acceleration function computes the total accelerations at the heliocentric positions.
+ * The sun's pull is then removed exactly; the Kepler drifts account for it.
+ */
+PRIVATE void interaction_accelerations( AccelerationFunction compute_accelerations )
+{
+    double sun_mu = object_array[0].mu;
+
+    heliocentric[0].position.x = heliocentric[0].position.y = heliocentric[0].position.z = 0.0;
+    heliocentric[0].velocity = heliocentric[0].position;
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        heliocentric[object_i].position.x = helio_x[object_i];
+        heliocentric[object_i].position.y = helio_y[object_i];
+        heliocentric[object_i].position.z = helio_z[object_i];
+        heliocentric[object_i].velocity.x = helio_vx[object_i];
+        heliocentric[object_i].velocity.y = helio_vy[object_i];
+        heliocentric[object_i].velocity.z = helio_vz[object_i];
+    }
+    compute_accelerations( heliocentric, accelerations, NULL );
+
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        Vector3 position = heliocentric[object_i].position;
+        double  distance = sqrt( magnitude_squared( position ) );
+
+        // Like the force kernels, an object at the sun's position feels no pull from it.
+        if( distance == 0.0 ) continue;
+        accelerations[object_i] = v3_add(
+            accelerations[object_i],
+            v3_multiply( sun_mu / ( distance * distance * distance ), position ) );
+    }
+}
+
+
+//! Add 'time_step' times the interaction accelerations to the barycentric velocities.
+PRIVATE void interaction_kick( double time_step )
+{
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        helio_vx[object_i] += time_step * accelerations[object_i].x;
+        helio_vy[object_i] += time_step * accelerations[object_i].y;
+        helio_vz[object_i] += time_step * accelerations[object_i].z;
+    }
+}
+
+
+//! Move every heliocentric position by 'time_step' times the sun's barycentric velocity.
+/*!
+ * This is the motion due to the term |sum of the planets' momenta|^2 / 2 m_sun of the
+ * Hamiltonian. It moves all the planets together so their separations do not change.
+ */
+PRIVATE void sun_drift( double time_step )
+{
+    double sun_mu = object_array[0].mu;
+    double px = 0.0, py = 0.0, pz = 0.0;
+
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        px += object_array[object_i].mu * helio_vx[object_i];
+        py += object_array[object_i].mu * helio_vy[object_i];
+        pz += object_array[object_i].mu * helio_vz[object_i];
+    }
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        helio_x[object_i] += time_step * px / sun_mu;
+        helio_y[object_i] += time_step * py / sun_mu;
+        helio_z[object_i] += time_step * pz / sun_mu;
+    }
+}
+
+
+// The Wisdom-Holman map in democratic heliocentric coordinates (Duncan, Levison, and Lee,
+// 1998). The planets' orbits about the sun are followed exactly by the Kepler solver and only
+// their mutual pulls, which are far weaker, are integrated. The step can then be a sizeable
+// fraction of the shortest orbital period. The state is converted from and back to
+// current_dynamics on each step. The mutual accelerations at the end of a step are those at
+// the start of the next because the sun's drift does not change the planets' separations.
+PRIVATE void wisdom_holman_step( AccelerationFunction compute_accelerations, double time_step )
+{
+    double  sun_mu   = object_array[0].mu;
+    double  total_mu = 0.0;
+    Vector3 center   = { 0.0, 0.0, 0.0 };
+    Vector3 center_velocity = center;
+    Vector3 weighted_position = center;
+    Vector3 weighted_velocity = center;
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        double mu = object_array[object_i].mu;
+
+        total_mu += mu;
+        center = v3_add( center, v3_multiply( mu, current_dynamics[object_i].position ) );
+        center_velocity =
+            v3_add( center_velocity, v3_multiply( mu, current_dynamics[object_i].velocity ) );
+    }
+    center          = v3_multiply( 1.0 / total_mu, center );
+    center_velocity = v3_multiply( 1.0 / total_mu, center_velocity );
+
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        Vector3 position =
+            v3_subtract( current_dynamics[object_i].position, current_dynamics[0].position );
+        Vector3 velocity = v3_subtract( current_dynamics[object_i].velocity, center_velocity );
+
+        helio_x[object_i]  = position.x;
+        helio_y[object_i]  = position.y;
+        helio_z[object_i]  = position.z;
+        helio_vx[object_i] = velocity.x;
+        helio_vy[object_i] = velocity.y;
+        helio_vz[object_i] = velocity.z;
+    }
+
+    if( !accelerations_valid ) interaction_accelerations( compute_accelerations );
+    sun_drift( 0.5 * time_step );
+    interaction_kick( 0.5 * time_step );
+    Kepler_drift( sun_mu, time_step, OBJECT_COUNT - 1,
+                  helio_x  + 1, helio_y  + 1, helio_z  + 1,
+                  helio_vx + 1, helio_vy + 1, helio_vz + 1 );
+    interaction_accelerations( compute_accelerations );
+    interaction_kick( 0.5 * time_step );
+    sun_drift( 0.5 * time_step );
+    accelerations_valid = 1;
+
+    // The barycenter moves uniformly. The sun's place is where it keeps the barycenter there
+    // and its velocity is the one that makes the total momentum about the barycenter zero.
+    center = v3_add( center, v3_multiply( time_step, center_velocity ) );
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        double  mu       = object_array[object_i].mu;
+        Vector3 position = { helio_x[object_i],  helio_y[object_i],  helio_z[object_i] };
+        Vector3 velocity = { helio_vx[object_i], helio_vy[object_i], helio_vz[object_i] };
+
+        weighted_position = v3_add( weighted_position, v3_multiply( mu, position ) );
+        weighted_velocity = v3_add( weighted_velocity, v3_multiply( mu, velocity ) );
+    }
+    current_dynamics[0].position =
+        v3_subtract( center, v3_multiply( 1.0 / total_mu, weighted_position ) );
+    current_dynamics[0].velocity =
+        v3_subtract( center_velocity, v3_multiply( 1.0 / sun_mu, weighted_velocity ) );
+    for( int object_i = 1; object_i < OBJECT_COUNT; ++object_i ) {
+        Vector3 position = { helio_x[object_i],  helio_y[object_i],  helio_z[object_i] };
+        Vector3 velocity = { helio_vx[object_i], helio_vy[object_i], helio_vz[object_i] };
+
+        current_dynamics[object_i].position = v3_add( current_dynamics[0].position, position );
+        current_dynamics[object_i].velocity = v3_add( center_velocity, velocity );
+    }
+}
+
+
+//! Allocate the RESPA method's arrays if that has not been done already.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int reserve_respa( void )
+{
+    if( near_accelerations != NULL ) return 0;
+
+    if( NeighborList_initialize( &near_list, OBJECT_COUNT ) != 0 ) return -1;
+    near_accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    if( near_accelerations == NULL ) {
+        NeighborList_destroy( &near_list );
+        return -1;
+    }
+    return 0;
+}
+
+
+//! Add 'time_step' times the near accelerations to the velocities.
+PRIVATE void kick_near( double time_step )
+{
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        current_dynamics[object_i].velocity = v3_add(
+            current_dynamics[object_i].velocity,
+            v3_multiply( time_step, near_accelerations[object_i] ) );
+    }
+}
+
+
+//! Split the forces at current_dynamics into near and far parts.
+/*!
+ * The near object lists are brought up to date first for pairs within 'radius' AU. The far
+ * accelerations are the total computed by the program less the near accelerations, so the two
+ * always add up to the force the program computes however the pairs are divided between them.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int split_forces( AccelerationFunction compute_accelerations, double radius )
+{
+    if( NeighborList_update( &near_list, current_dynamics,
+                             radius * AU, options.list_skin * AU ) < 0 ) return -1;
+    compute_accelerations( current_dynamics, accelerations, NULL );
+    NeighborList_accelerations( &near_list, current_dynamics, near_accelerations );
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        accelerations[object_i] =
+            v3_subtract( accelerations[object_i], near_accelerations[object_i] );
+    }
+    return 0;
+}
+
+
+// The far forces kick at the ends of the step and options.respa_steps leapfrog steps with the
+// near forces come between. The step is symmetric so the method is time reversible; the near
+// lists change only at the ends of steps, between the two far half kicks that meet there.
+PRIVATE int respa_step( AccelerationFunction compute_accelerations, double time_step )
+{
+    int    inner_count = options.respa_steps;
+    double inner_step  = time_step / inner_count;
+
+    if( !accelerations_valid ) {
+        if( split_forces( compute_accelerations, options.near_radius ) != 0 ) return -1;
+        accelerations_valid = 1;
+    }
+
+    kick( 0.5 * time_step );
+    for( int inner = 0; inner < inner_count; ++inner ) {
+        kick_near( 0.5 * inner_step );
+        drift( inner_step );
+        if( inner < inner_count - 1 ) {
+            NeighborList_accelerations( &near_list, current_dynamics, near_accelerations );
+        }
+        else if( split_forces( compute_accelerations, options.near_radius ) != 0 ) {
+            accelerations_valid = 0;
+            return -1;
+        }
+        kick_near( 0.5 * inner_step );
+    }
+    kick( 0.5 * time_step );
+    return 0;
+}
+
+
+//! Allocate the encounter method's arrays if that has not been done already.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int reserve_encounter( void )
+{
+    if( reserve_respa( ) != 0 ) return -1;
+    if( encounter_order == NULL ) {
+        encounter_order = (int *)malloc( OBJECT_COUNT * sizeof(int) );
+        if( encounter_order == NULL ) return -1;
+    }
+    return 0;
+}
+
+
+//! Add 'time_step' times the near accelerations to the velocities of some objects.
+PRIVATE void kick_near_some( const int *objects, int object_count, double time_step )
+{
+    for( int i = 0; i < object_count; ++i ) {
+        current_dynamics[objects[i]].velocity = v3_add(
+            current_dynamics[objects[i]].velocity,
+            v3_multiply( time_step, near_accelerations[objects[i]] ) );
+    }
+}
+
+
+//! Add 'time_step' times the velocities to the positions of some objects.
+PRIVATE void drift_some( const int *objects, int object_count, double time_step )
+{
+    for( int i = 0; i < object_count; ++i ) {
+        current_dynamics[objects[i]].position = v3_add(
+            current_dynamics[objects[i]].position,
+            v3_multiply( time_step, current_dynamics[objects[i]].velocity ) );
+    }
+}
+
+
+//! Return the number of substeps the near pairs need in a step of 'time_step' seconds.
+/*!
+ * Each near pair is assumed to move in a straight line over the step. The substep is
+ * options.step_accuracy times the shortest time scale of a pair at its closest approach: the
+ * time to cover its separation at its relative speed or its free fall time.
+ */
+PRIVATE int encounter_substeps( double time_step )
+{
+    double shortest = time_step / options.step_accuracy;
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        for( int k = near_list.start[object_i]; k < near_list.start[object_i + 1]; ++k ) {
+            int object_j = near_list.neighbors[k];
+
+            if( object_j < object_i ) continue;
+            Vector3 separation = v3_subtract(
+                current_dynamics[object_j].position, current_dynamics[object_i].position );
+            Vector3 velocity   = v3_subtract(
+                current_dynamics[object_j].velocity, current_dynamics[object_i].velocity );
+            double  speed_squared = magnitude_squared( velocity );
+            double  mu            = object_array[object_i].mu + object_array[object_j].mu;
+
+            // The time of closest approach within the step.
+            if( speed_squared > 0.0 ) {
+                double closest = -( separation.x * velocity.x + separation.y * velocity.y +
+                                    separation.z * velocity.z ) / speed_squared;
+                if( closest > time_step ) closest = time_step;
+                if( closest > 0.0 )
+                    separation = v3_add( separation, v3_multiply( closest, velocity ) );
+            }
+
+            double distance = sqrt( magnitude_squared( separation ) );
+            double speed    = sqrt( speed_squared );
+
+            if( speed > 0.0 && distance / speed < shortest ) shortest = distance / speed;
+            if( mu > 0.0 && sqrt( distance * distance * distance / mu ) < shortest )
+                shortest = sqrt( distance * distance * distance / mu );
+        }
+    }
+
+    double substeps = ceil( time_step / ( options.step_accuracy * shortest ) );
+    if( substeps > options.encounter_substeps ) return options.encounter_substeps;
+    return ( substeps > 1.0 ) ? (int)substeps : 1;
+}
+
+
+// This is the RESPA method with the near forces limited to close encounters and the substeps
+// taken only by the objects in them. The far forces kick everything at the ends of the step.
+// The objects with near neighbors then take as many leapfrog substeps with the near forces as
+// the closest of their encounters needs while the others drift over the whole step at once.
+PRIVATE int encounter_step( AccelerationFunction compute_accelerations, double time_step )
+{
+    int close_count = 0;
+    int apart_count = 0;
+
+    if( !accelerations_valid ) {
+        if( split_forces( compute_accelerations, options.encounter_radius ) != 0 ) return -1;
+        accelerations_valid = 1;
+    }
+
+    // The objects in encounters are put at the front of the order and the others at the back.
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        if( near_list.start[object_i + 1] > near_list.start[object_i] )
+            encounter_order[close_count++] = object_i;
+        else
+            encounter_order[OBJECT_COUNT - ++apart_count] = object_i;
+    }
+
+    int    inner_count = ( close_count > 0 ) ? encounter_substeps( time_step ) : 1;
+    double inner_step  = time_step / inner_count;
+
+    kick( 0.5 * time_step );
+    for( int inner = 0; inner < inner_count; ++inner ) {
+        kick_near_some( encounter_order, close_count, 0.5 * inner_step );
+        drift_some( encounter_order, close_count, inner_step );
+        if( inner < inner_count - 1 ) {
+            NeighborList_some_accelerations( &near_list, current_dynamics,
+                                             encounter_order, close_count, near_accelerations );
+            kick_near_some( encounter_order, close_count, 0.5 * inner_step );
+        }
+    }
+
+    // The objects that were apart catch up. The encounters may change with the new lists.
+    drift_some( &encounter_order[OBJECT_COUNT - apart_count], apart_count, time_step );
+    if( split_forces( compute_accelerations, options.encounter_radius ) != 0 ) {
+        accelerations_valid = 0;
+        return -1;
+    }
+    kick_near( 0.5 * inner_step );
+    kick( 0.5 * time_step );
+    return 0;
+}
+
+
+PUBLIC int Integrator_step( AccelerationFunction compute_accelerations, double time_step )
+{
+    if( accelerations == NULL ) {
+        accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+        if( accelerations == NULL ) return -1;
+    }
+
+    switch( options.integrator ) {
+    case INTEGRATOR_EULER:
+        euler_step( compute_accelerations, time_step );
+        break;
+
+    // Without a way to compute the accelerations of only some objects, every object takes the
+    // base step. That is the block method with every object on level zero.
+    case INTEGRATOR_LEAPFROG:
+    case INTEGRATOR_BLOCK:
+        leapfrog_step( compute_accelerations, time_step );
+        break;
+
+    case INTEGRATOR_HERMITE:
+        if( reserve_hermite( ) != 0 ) return -1;
+        hermite_step( compute_accelerations, time_step );
+        break;
+
+    case INTEGRATOR_WISDOM_HOLMAN:
+        if( reserve_wisdom_holman( ) != 0 ) return -1;
+        wisdom_holman_step( compute_accelerations, time_step );
+        break;
+
+    case INTEGRATOR_IAS15:
+        return IAS15_advance( compute_accelerations, time_step );
+
+    case INTEGRATOR_RESPA:
+        if( reserve_respa( ) != 0 ) return -1;
+        return respa_step( compute_accelerations, time_step );
+
+    case INTEGRATOR_YOSHIDA4:
+        composition_step( compute_accelerations, time_step, yoshida4_weights, 3 );
+        break;
+
+    case INTEGRATOR_YOSHIDA6:
+        composition_step( compute_accelerations, time_step, yoshida6_weights, 7 );
+        break;
+
+    case INTEGRATOR_ENCOUNTER:
+        if( reserve_encounter( ) != 0 ) return -1;
+        return encounter_step( compute_accelerations, time_step );
+    }
+    return 0;
+}
+
+
+//! Return the shortest dynamical time of the objects in current_dynamics.
+/*!
+ * Each object's time is the shortest of its distance from the sun over its speed relative to
+ * the sun, its free fall time to the sun (sqrt(r^3 / mu) with the sun's mu), and its
+ * acceleration over the rate of change of its acceleration. The first two are the orbital
+ * time scale; the last becomes short during a close encounter. The rates of change are the
+ * jerks if they are known or else the change in the accelerations over the last step. The
+ * accelerations at the start of the step must be in 'accelerations'.
+ */
+PRIVATE double dynamical_time( void )
+{
+    double sun_mu   = object_array[0].mu;
+    double shortest = HUGE_VAL;
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        double  acceleration = sqrt( magnitude_squared( accelerations[object_i] ) );
+        Vector3 rate;
+
+        if( object_i > 0 ) {
+            Vector3 position = v3_subtract(
+                current_dynamics[object_i].position, current_dynamics[0].position );
+            Vector3 velocity = v3_subtract(
+                current_dynamics[object_i].velocity, current_dynamics[0].velocity );
+            double  distance = sqrt( magnitude_squared( position ) );
+            double  speed    = sqrt( magnitude_squared( velocity ) );
+
+            if( speed > 0.0 && distance / speed < shortest ) shortest = distance / speed;
+            if( sun_mu > 0.0 && distance > 0.0 ) {
+                double free_fall = sqrt( distance * distance * distance / sun_mu );
+                if( free_fall < shortest ) shortest = free_fall;
+            }
+        }
+
+        if( options.integrator == INTEGRATOR_HERMITE )
+            rate = jerks[object_i];
+        else if( previous_step > 0.0 )
+            rate = v3_multiply( 1.0 / previous_step,
+                v3_subtract( accelerations[object_i], previous_accelerations[object_i] ) );
+        else
+            continue;
+
+        double change = sqrt( magnitude_squared( rate ) );
+        if( change > 0.0 && acceleration / change < shortest ) shortest = acceleration / change;
+    }
+    return shortest;
+}
+
+
+PUBLIC double Integrator_choose_step(
+    AccelerationFunction compute_accelerations, double maximum )
+{
+    double step;
+
+    switch( options.integrator ) {
+    case INTEGRATOR_EULER:
+    case INTEGRATOR_LEAPFROG:
+    case INTEGRATOR_HERMITE:
+    case INTEGRATOR_YOSHIDA4:
+    case INTEGRATOR_YOSHIDA6:
+        break;
+    default:
+        return maximum;
+    }
+
+    if( accelerations == NULL ) {
+        accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+        if( accelerations == NULL ) return -1.0;
+    }
+    if( previous_accelerations == NULL ) {
+        previous_accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+        if( previous_accelerations == NULL ) return -1.0;
+    }
+    if( options.integrator == INTEGRATOR_HERMITE && reserve_hermite( ) != 0 ) return -1.0;
+
+    // The step methods use these accelerations rather than computing them again.
+    if( !accelerations_valid ) {
+        compute_accelerations( current_dynamics, accelerations,
+            ( options.integrator == INTEGRATOR_HERMITE ) ? jerks : NULL );
+        accelerations_valid = 1;
+    }
+
+    // The step may at most double from one step to the next. An encounter that begins during
+    // a step is then noticed before the step has grown too long for it.
+    step = options.step_accuracy * dynamical_time( );
+    if( previous_step > 0.0 && step > 2.0 * previous_step ) step = 2.0 * previous_step;
+    if( step > maximum ) step = maximum;
+
+    memcpy( previous_accelerations, accelerations, OBJECT_COUNT * sizeof(Vector3) );
+    previous_step = step;
+    return step;
+}
+
+
+//! Add 'time_step' times the acceleration of one object to its velocity.
+PRIVATE void kick_object( int object_i, double time_step )
+{
+    current_dynamics[object_i].velocity = v3_add(
+        current_dynamics[object_i].velocity,
+        v3_multiply( time_step, accelerations[object_i] ) );
+}
+
+
+//! Return the level of the step an object should take from base step number 'base_step'.
+/*!
+ * The longest step no longer than options.step_accuracy * |v| / |a| is used, provided it
+ * starts at a multiple of itself. If even the base step is too long the base step is used.
+ */
+PRIVATE int choose_level( int object_i, long long base_step, double time_step )
+{
+    // The steps are counted in a long long. Limiting the level keeps them representable.
+    int    maximum_level = ( options.block_levels < 30 ) ? options.block_levels : 30;
+    double speed         = sqrt( magnitude_squared( current_dynamics[object_i].velocity ) );
+    double acceleration  = sqrt( magnitude_squared( accelerations[object_i] ) );
+    int    level         = 0;
+
+    while( level < maximum_level ) {
+        long long longer_step = 1LL << ( level + 1 );
+
+        if( base_step % longer_step != 0 ) break;
+        if( acceleration > 0.0 &&
+            longer_step * time_step > options.step_accuracy * speed / acceleration ) break;
+        ++level;
+    }
+    return level;
+}
+
+
+//! Allocate the block method's arrays if that has not been done already.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int reserve_block( void )
+{
+    if( levels != NULL ) return 0;
+
+    levels = (int *)malloc( OBJECT_COUNT * sizeof(int) );
+    active = (int *)malloc( OBJECT_COUNT * sizeof(int) );
+    if( levels == NULL || active == NULL ) {
+        free( levels ); free( active );
+        levels = active = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+
+PUBLIC int Integrator_block_step(
+    ActiveAccelerationFunction compute_accelerations, double time_step )
+{
+    int active_count = 0;
+
+    if( accelerations == NULL ) {
+        accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+        if( accelerations == NULL ) return -1;
+    }
+    if( reserve_block( ) != 0 ) return -1;
+
+    // At the start every object is kicked into the first half of its step.
+    if( !accelerations_valid ) {
+        for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+            active[object_i] = object_i;
+        }
+        compute_accelerations( current_dynamics, active, OBJECT_COUNT, accelerations );
+        base_steps = 0;
+        for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+            levels[object_i] = choose_level( object_i, 0, time_step );
+            kick_object( object_i, 0.5 * time_step * ( 1LL << levels[object_i] ) );
+        }
+        accelerations_valid = 1;
+    }
+
+    // Every object's position is predicted. The objects at the ends of their steps are active.
+    drift( time_step );
+    ++base_steps;
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        if( base_steps % ( 1LL << levels[object_i] ) == 0 ) active[active_count++] = object_i;
+    }
+    if( active_count == 0 ) return 0;
+
+    // The active objects finish their steps and start the next ones, possibly of a new size.
+    compute_accelerations( current_dynamics, active, active_count, accelerations );
+    for( int i = 0; i < active_count; ++i ) {
+        int object_i = active[i];
+
+        kick_object( object_i, 0.5 * time_step * ( 1LL << levels[object_i] ) );
+        levels[object_i] = choose_level( object_i, base_steps, time_step );
+        kick_object( object_i, 0.5 * time_step * ( 1LL << levels[object_i] ) );
+    }
+    return 0;
+}
+
+
+PUBLIC int Integrator_derivatives(
+    const Vector3 **known_accelerations, const Vector3 **known_jerks )
+{
+    if( options.integrator == INTEGRATOR_HERMITE && accelerations_valid && jerks != NULL ) {
+        *known_accelerations = accelerations;
+        *known_jerks         = jerks;
+        return 1;
+    }
+    *known_accelerations = NULL;
+    *known_jerks         = NULL;
+    return 0;
+}
+
+
+PUBLIC void Integrator_reset( void )
+{
+    accelerations_valid = 0;
+    previous_step = 0.0;
+    near_list.valid = 0;
+    IAS15_reset( );
+}
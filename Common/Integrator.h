@@ -0,0 +1,113 @@
+/*! \file    Integrator.h
+ *  \brief   Interface to the methods of advancing a simulation in time.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * Each program computes forces in its own way (all-pairs kernels with threads, an octree, and
+ * so forth) but the way positions and velocities are advanced from the accelerations does not
+ * depend on how the accelerations were computed. The functions here advance current_dynamics
+ * using a function, supplied by the program, that computes the accelerations of all objects
+ * for given positions. The method used is selected by options.integrator.
+ *
+ * The methods are described with their implementations in Integrator.c. The Wisdom-Holman
+ * method's Kepler solver and the IAS15 method have interfaces of their own (Kepler.h, IAS15.h).
+ */
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "global.h"
+
+//! Function that computes the acceleration of every object at the positions in 'dynamics'.
+/*!
+ * The accelerations of all OBJECT_COUNT objects must be written to 'accelerations'. If 'jerks'
+ * is not NULL the time derivatives of the accelerations, which depend on the velocities in
+ * 'dynamics', must be written to it as well. It is NULL unless options.integrator is
+ * INTEGRATOR_HERMITE.
+ */
+typedef void (*AccelerationFunction)(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks );
+
+//! Function that computes the accelerations of some objects at the positions in 'dynamics'.
+/*!
+ * The acceleration of object active[i], for i in [0, active_count), must be written to
+ * accelerations[active[i]]. The other elements of 'accelerations' must not be changed.
+ */
+typedef void (*ActiveAccelerationFunction)( const ObjectDynamics *dynamics,
+    const int *active, int active_count, Vector3 *accelerations );
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Advance current_dynamics by one step of 'time_step' seconds using options.integrator.
+/*!
+ * The same acceleration function should be used for every step of a simulation.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int Integrator_step( AccelerationFunction compute_accelerations, double time_step );
+
+//! Advance current_dynamics by one base step of 'time_step' seconds with block time steps.
+/*!
+ * Each object takes leapfrog steps of its own, a power of two multiple of the base step (at
+ * most 2^options.block_levels). Every object drifts but only the objects whose steps end are
+ * kicked, so only their accelerations are computed. The same acceleration function and base
+ * step should be used for every step of a simulation.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int Integrator_block_step(
+    ActiveAccelerationFunction compute_accelerations, double time_step );
+
+//! Return the length of the next step for options.step_control equal to STEP_ADAPTIVE.
+/*!
+ * The step is options.step_accuracy times the shortest dynamical time of the objects, which
+ * is short during close encounters, but no longer than 'maximum' and no more than twice the
+ * last step chosen. It applies to the Euler, leapfrog, Hermite, and Yoshida methods; for others
+ * 'maximum' is returned. The accelerations at the current state are kept for the next call of
+ * Integrator_step, which must use the step returned, so no forces are computed twice. A
+ * variable step spoils the symplectic property: the energy error no longer stays bounded.
+ *
+ * \return The length of the step or a negative value if memory could not be allocated.
+ */
+double Integrator_choose_step( AccelerationFunction compute_accelerations, double maximum );
+
+//! Return the state of one object predicted 'time_step' seconds after 'state'.
+/*!
+ * This is the Hermite method's prediction: a Taylor series using the object's acceleration and
+ * jerk at 'state'. Programs that take Hermite steps themselves use it to share the method.
+ */
+ObjectDynamics Integrator_hermite_predict(
+    const ObjectDynamics *state, Vector3 acceleration, Vector3 jerk, double time_step );
+
+//! Correct the state of one object at the end of a Hermite step of 'time_step' seconds.
+/*!
+ * 'state' holds the object's state at the start of the step and is replaced by its state at
+ * the end. The accelerations and jerks are those at the start of the step ('a0', 'j0') and at
+ * the predicted state ('a1', 'j1').
+ */
+void Integrator_hermite_correct( ObjectDynamics *state,
+    Vector3 a0, Vector3 j0, Vector3 a1, Vector3 j1, double time_step );
+
+//! Get the accelerations and jerks of current_dynamics kept by the Hermite method.
+/*!
+ * The Hermite method ends each step knowing both. They are useful for interpolating between
+ * steps (see DenseOutput.h). The arrays belong to the integrator and are valid until the next
+ * step. For the other methods, or before the first step, both pointers are set to NULL.
+ *
+ * \return Nonzero if the accelerations and jerks are known.
+ */
+int Integrator_derivatives( const Vector3 **accelerations, const Vector3 **jerks );
+
+//! Forget the accelerations kept from the previous step.
+/*!
+ * This must be called if current_dynamics is changed other than by Integrator_step (for
+ * example, when it is restored to its initial state).
+ */
+void Integrator_reset( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+/*! \file    Kepler.c
+ *  \brief   Implementation of the solver of Kepler's problem in universal variables.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <math.h>
+#include "Kepler.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+// The iteration stops when the correction is this small relative to the universal anomaly.
+#define TOLERANCE 1.0E-15
+
+// The Laguerre-Conway iteration normally converges in a few steps. This is a safety limit.
+#define MAXIMUM_ITERATIONS 50
+
+//! Structure that holds the Stumpff functions c0 through c3 of one argument.
+typedef struct {
+    double c0, c1, c2, c3;
+} Stumpff;
+
+
+//! Compute the Stumpff functions of 'z'.
+/*!
+ * The argument is divided by four until it is small enough for a short series and the results
+ * are then carried back to the original argument with the quadrupling formulas.
+ */
+PRIVATE Stumpff stumpff( double z )
+{
+    Stumpff result;
+    int     reductions = 0;
+
+    while( fabs( z ) > 0.1 ) {
+        z *= 0.25;
+        ++reductions;
+    }
+    result.c2 = ( 1.0 - z / 12.0 * ( 1.0 - z / 30.0 * ( 1.0 - z / 56.0 *
+                ( 1.0 - z / 90.0 * ( 1.0 - z / 132.0 ) ) ) ) ) / 2.0;
+    result.c3 = ( 1.0 - z / 20.0 * ( 1.0 - z / 42.0 * ( 1.0 - z / 72.0 *
+                ( 1.0 - z / 110.0 * ( 1.0 - z / 156.0 ) ) ) ) ) / 6.0;
+    result.c1 = 1.0 - z * result.c3;
+    result.c0 = 1.0 - z * result.c2;
+
+    for( int i = 0; i < reductions; ++i ) {
+        Stumpff quarter = result;
+
+        result.c3 = 0.25 * ( quarter.c2 + quarter.c0 * quarter.c3 );
+        result.c2 = 0.5  * quarter.c1 * quarter.c1;
+        result.c1 = quarter.c0 * quarter.c1;
+        result.c0 = 2.0  * quarter.c0 * quarter.c0 - 1.0;
+    }
+    return result;
+}
+
+
+PUBLIC void Kepler_drift( double mu, double time_step, int count,
+                          double *x,  double *y,  double *z,
+                          double *vx, double *vy, double *vz )
+{
+    for( int i = 0; i < count; ++i ) {
+        double r0 = sqrt( x[i] * x[i] + y[i] * y[i] + z[i] * z[i] );
+
+        if( r0 == 0.0 ) continue;
+
+        double v2   = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+        double eta  = x[i] * vx[i] + y[i] * vy[i] + z[i] * vz[i];
+        double beta = 2.0 * mu / r0 - v2;       // mu / a; positive for a bound orbit.
+        double zeta = mu - beta * r0;
+        double dt   = time_step;
+
+        // Whole periods of a bound orbit change nothing. Removing them keeps the anomaly small.
+        if( beta > 0.0 ) {
+            double period = 2.0 * M_PI * mu / ( beta * sqrt( beta ) );
+            dt = fmod( dt, period );
+        }
+
+        // Solve r0 s + eta G2(s) + zeta G3(s) = dt for the universal anomaly s.
+        double  s = dt / r0;
+        double  r = r0;
+        Stumpff c;
+
+        for( int iteration = 0; iteration < MAXIMUM_ITERATIONS; ++iteration ) {
+            const double n = 5.0;   // The degree assumed by the Laguerre-Conway iteration.
+
+            c = stumpff( beta * s * s );
+            double g1 = s * c.c1;
+            double g2 = s * s * c.c2;
+            double g3 = s * s * s * c.c3;
+            double f  = r0 * s + eta * g2 + zeta * g3 - dt;
+            double f1 = r0 + eta * g1 + zeta * g2;
+            double f2 = eta * c.c0 + zeta * g1;
+            double root = sqrt( fabs( ( n - 1.0 ) * ( n - 1.0 ) * f1 * f1 -
+                                      n * ( n - 1.0 ) * f * f2 ) );
+            double ds = n * f / ( f1 + ( ( f1 < 0.0 ) ? -root : root ) );
+
+            s -= ds;
+            if( fabs( ds ) <= TOLERANCE * fabs( s ) ) break;
+        }
+
+        // The Gauss f and g functions and their derivatives give the new state.
+        c = stumpff( beta * s * s );
+        double g1 = s * c.c1;
+        double g2 = s * s * c.c2;
+        double g3 = s * s * s * c.c3;
+        r = r0 + eta * g1 + zeta * g2;
+
+        double f     = 1.0 - mu * g2 / r0;
+        double g     = dt - mu * g3;
+        double f_dot = -mu * g1 / ( r0 * r );
+        double g_dot = 1.0 - mu * g2 / r;
+
+        double new_x = f * x[i] + g * vx[i];
+        double new_y = f * y[i] + g * vy[i];
+        double new_z = f * z[i] + g * vz[i];
+
+        vx[i] = f_dot * x[i] + g_dot * vx[i];
+        vy[i] = f_dot * y[i] + g_dot * vy[i];
+        vz[i] = f_dot * z[i] + g_dot * vz[i];
+        x[i]  = new_x;
+        y[i]  = new_y;
+        z[i]  = new_z;
+    }
+}
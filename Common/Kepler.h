@@ -0,0 +1,44 @@
+/*! \file    Kepler.h
+ *  \brief   Interface to the solver of Kepler's problem in universal variables.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * Each object moving about the sun alone follows a conic section that can be computed exactly
+ * rather than integrated step by step. The solver here advances many such objects at once.
+ * The positions and velocities are given relative to the central body as separate component
+ * arrays, like those of a BodyStore, and the objects are independent of one another, so the
+ * work on each is the same sequence of arithmetic on different data.
+ *
+ * The solution is written in universal variables (see Danby, "Fundamentals of Celestial
+ * Mechanics"), which treat elliptic, parabolic, and hyperbolic orbits alike. Kepler's equation
+ * for the universal anomaly is solved with the Laguerre-Conway iteration, which converges from
+ * the simple starting value used here even for very eccentric orbits. The Stumpff functions
+ * are evaluated from a short series after reducing the argument by powers of four, so no
+ * trigonometric or hyperbolic functions are called and the same code serves every orbit.
+ */
+
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Advance 'count' objects along their Kepler orbits by 'time_step' seconds.
+/*!
+ * \param mu The gravitational parameter (G times the mass) of the central body.
+ * \param time_step The time to advance. It may be negative.
+ * \param count The number of objects.
+ * \param x, y, z The positions relative to the central body. They are updated in place.
+ * \param vx, vy, vz The velocities relative to the central body. They are updated in place.
+ *
+ * An object at the position of the central body is left where it is.
+ */
+void Kepler_drift( double mu, double time_step, int count,
+                   double *x,  double *y,  double *z,
+                   double *vx, double *vy, double *vz );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*! \file    NeighborList.c
+ *  \brief   Implementation of the lists of near neighbors.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "NeighborList.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+
+PUBLIC int NeighborList_initialize( NeighborList *self, int count )
+{
+    memset( self, 0, sizeof(NeighborList) );
+    self->count    = count;
+    self->start    = (int *)malloc( ( count + 1 ) * sizeof(int) );
+    self->built_at = (Vector3 *)malloc( count * sizeof(Vector3) );
+    if( self->start == NULL || self->built_at == NULL ) {
+        NeighborList_destroy( self );
+        return -1;
+    }
+    return 0;
+}
+
+
+PUBLIC void NeighborList_destroy( NeighborList *self )
+{
+    // It is safe to pass NULL to free( ).
+    free( self->start );
+    free( self->neighbors );
+    free( self->built_at );
+
+    // Put the left over list into a well defined state.
+    memset( self, 0, sizeof(NeighborList) );
+}
+
+
+//! Return nonzero if some object has moved more than half the skin since the list was built.
+PRIVATE int moved_too_far( const NeighborList *self, const ObjectDynamics *dynamics )
+{
+    double limit = 0.25 * self->skin * self->skin;
+
+    for( int object_i = 0; object_i < self->count; ++object_i ) {
+        Vector3 moved = v3_subtract( dynamics[object_i].position, self->built_at[object_i] );
+        if( magnitude_squared( moved ) > limit ) return 1;
+    }
+    return 0;
+}
+
+
+PUBLIC int NeighborList_update(
+    NeighborList *self, const ObjectDynamics *dynamics, double radius, double skin )
+{
+    double reach_squared = ( radius + skin ) * ( radius + skin );
+    int    used          = 0;
+
+    if( self->valid && self->radius == radius && self->skin == skin &&
+        !moved_too_far( self, dynamics ) ) return 0;
+
+    self->valid = 0;
+    for( int object_i = 0; object_i < self->count; ++object_i ) {
+        Vector3 position = dynamics[object_i].position;
+
+        self->start[object_i] = used;
+        for( int object_j = 0; object_j < self->count; ++object_j ) {
+            if( object_j == object_i ||
+                magnitude_squared( v3_subtract( dynamics[object_j].position, position ) ) >=
+                    reach_squared ) continue;
+
+            // Near objects are usually few. The array grows when they are not.
+            if( used == self->capacity ) {
+                int  new_capacity = ( self->capacity > 0 ) ? 2 * self->capacity : self->count;
+                int *new_neighbors =
+                    (int *)realloc( self->neighbors, new_capacity * sizeof(int) );
+
+                if( new_neighbors == NULL ) return -1;
+                self->neighbors = new_neighbors;
+                self->capacity  = new_capacity;
+            }
+            self->neighbors[used++] = object_j;
+        }
+        self->built_at[object_i] = position;
+    }
+    self->start[self->count] = used;
+    self->radius = radius;
+    self->skin   = skin;
+    self->valid  = 1;
+    return 1;
+}
+
+
+//! Return the acceleration of one object due to its neighbors.
+PRIVATE Vector3 neighbor_acceleration(
+    const NeighborList *self, const ObjectDynamics *dynamics, int object_i )
+{
+    Vector3 position = dynamics[object_i].position;
+    Vector3 total    = { 0.0, 0.0, 0.0 };
+
+    for( int k = self->start[object_i]; k < self->start[object_i + 1]; ++k ) {
+        int     object_j         = self->neighbors[k];
+        Vector3 displacement     = v3_subtract( dynamics[object_j].position, position );
+        double  distance_squared = magnitude_squared( displacement );
+
+        if( distance_squared == 0.0 ) continue;
+
+        double distance = sqrt( distance_squared );
+        total = v3_add( total, v3_multiply(
+            object_array[object_j].mu / ( distance_squared * distance ), displacement ) );
+    }
+    return total;
+}
+
+
+PUBLIC void NeighborList_accelerations(
+    const NeighborList *self, const ObjectDynamics *dynamics, Vector3 *accelerations )
+{
+    for( int object_i = 0; object_i < self->count; ++object_i ) {
+        accelerations[object_i] = neighbor_acceleration( self, dynamics, object_i );
+    }
+}
+
+
+PUBLIC void NeighborList_some_accelerations(
+    const NeighborList *self, const ObjectDynamics *dynamics,
+    const int *objects, int object_count, Vector3 *accelerations )
+{
+    for( int i = 0; i < object_count; ++i ) {
+        accelerations[objects[i]] = neighbor_acceleration( self, dynamics, objects[i] );
+    }
+}
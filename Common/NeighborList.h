@@ -0,0 +1,78 @@
+/*! \file    NeighborList.h
+ *  \brief   Lists of the objects near each object, rebuilt only when they might be wrong.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * A NeighborList records, for each object, the other objects within a given radius plus a
+ * margin (the skin) of it. The forces between near objects change quickly and are wanted more
+ * often than the others; the list lets them be summed without looking at every pair. The list
+ * stays correct until some object has moved half the skin since it was built: until then no
+ * pair can have closed from outside radius + skin to inside the radius. Building the list
+ * looks at every pair but it is needed only occasionally.
+ *
+ * Each pair appears twice, once in the list of each of its objects, so the near forces on
+ * different objects can be computed independently.
+ */
+
+#ifndef NEIGHBORLIST_H
+#define NEIGHBORLIST_H
+
+#include "global.h"
+
+//! Structure that holds the near neighbors of each object.
+typedef struct {
+    int      count;           //!< Number of objects.
+    int     *start;           //!< Object i's neighbors are at [start[i], start[i + 1]).
+    int     *neighbors;       //!< The object IDs of the neighbors of all objects.
+    int      capacity;        //!< Number of elements allocated for neighbors.
+    Vector3 *built_at;        //!< The positions of the objects when the list was built.
+    double   radius;          //!< The radius the list was built for.
+    double   skin;            //!< The margin beyond the radius included in the list.
+    int      valid;           //!< Nonzero if the list has been built.
+} NeighborList;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Allocate the arrays for a list of 'count' objects. The list is built by the first update.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int NeighborList_initialize( NeighborList *self, int count );
+
+//! Release the memory held by the list.
+void NeighborList_destroy( NeighborList *self );
+
+//! Rebuild the list for the positions in 'dynamics' if it might no longer be correct.
+/*!
+ * The list is rebuilt if it was never built, if the radius or skin is different, or if some
+ * object has moved more than half the skin since it was built. The list then holds, for each
+ * object, the other objects closer than radius + skin.
+ *
+ * \return One if the list was rebuilt, zero if it was not, or -1 if memory could not be
+ * allocated (the list is then left unbuilt).
+ */
+int NeighborList_update(
+    NeighborList *self, const ObjectDynamics *dynamics, double radius, double skin );
+
+//! Compute the acceleration of each object due to its neighbors only.
+/*!
+ * The gravitational parameters are taken from object_array. All self->count accelerations are
+ * written; an object with no neighbors gets zero.
+ */
+void NeighborList_accelerations(
+    const NeighborList *self, const ObjectDynamics *dynamics, Vector3 *accelerations );
+
+//! Compute the acceleration due to its neighbors of each object in 'objects' only.
+/*!
+ * The acceleration of objects[i], for i in [0, object_count), is written to
+ * accelerations[objects[i]]. The other elements of 'accelerations' are not changed.
+ */
+void NeighborList_some_accelerations( const NeighborList *self, const ObjectDynamics *dynamics,
+    const int *objects, int object_count, Vector3 *accelerations );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,428 @@
+/*! \file    Options.c
+ *  \brief   Implementation of the run time options.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__GLIBC__) || defined(__CYGWIN__)
+#include <sys/sysinfo.h>
+#endif
+#include "global.h"
+#include "Options.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+PUBLIC Options options = {
+    .force_method     = FORCE_SYMMETRIC,
+    .tile_rows        = 256,
+    .tile_columns     = 1024,
+    .precision        = PRECISION_DOUBLE,
+    .rsqrt_iterations = 0,
+    .fixed_kernels    = 1,
+    .ensemble_size    = 0,
+    .threads          = 0,
+    .chunk_size       = 0,
+    .theta            = 0.5,
+    .leaf_size        = 1,
+    .tree_builder     = TREE_INSERT,
+    .opening          = OPENING_SIZE,
+    .autotune         = 0,
+    .profile          = 1,
+    .error_bound      = 0.0,
+    .integrator       = INTEGRATOR_EULER,
+    .block_levels     = 6,
+    .step_accuracy    = 0.01,
+    .ias15_epsilon    = 1.0E-9,
+    .time_step        = TIME_STEP,
+    .step_control     = STEP_FIXED,
+    .respa_steps      = 4,
+    .near_radius      = 0.1,
+    .list_skin        = 0.05,
+    .encounter_radius   = 0.01,
+    .encounter_substeps = 1024,
+    .parareal_iterations  = 0,
+    .parareal_coarse      = INTEGRATOR_LEAPFROG,
+    .parareal_coarse_step = 8.64E+04,
+    .parareal_tolerance   = 1.0E-9,
+    .epochs               = ""
+};
+
+//! The kinds of values an option can take.
+enum OptionType {
+    OPTION_CHOICE,     // One of a fixed list of names. Stored as an int (enumeration).
+    OPTION_INT,        // An integer no smaller than the descriptor's minimum.
+    OPTION_DOUBLE,     // A floating point number no smaller than the descriptor's minimum.
+    OPTION_POSITIVE,   // A floating point number greater than zero. Stored as a double.
+    OPTION_TEXT        // Any text shorter than OPTION_TEXT_SIZE. Stored as a char array.
+};
+
+//! Structure that describes one command line option.
+struct OptionDescriptor {
+    const char      *name;
+    enum OptionType  type;
+    void            *value;
+    const char     **choices;   // NULL terminated list of names for OPTION_CHOICE.
+    int              minimum;   // Smallest value allowed for OPTION_INT or OPTION_DOUBLE.
+    const char      *help;
+};
+
+PRIVATE const char *force_method_names[] = { "direct", "symmetric", "tiled", NULL };
+PRIVATE const char *precision_names[]    = { "double", "mixed", NULL };
+PRIVATE const char *switch_names[]       = { "off", "on", NULL };
+PRIVATE const char *step_control_names[] = { "fixed", "adaptive", NULL };
+PRIVATE const char *tree_builder_names[] = { "insert", "morton", NULL };
+PRIVATE const char *opening_names[]      = { "size", "radius", NULL };
+PRIVATE const char *integrator_names[]   = { "euler", "leapfrog", "hermite", "block",
+                                               "wisdom-holman", "ias15", "respa",
+                                               "yoshida4", "yoshida6", "encounter", NULL };
+
+PRIVATE struct OptionDescriptor descriptors[] = {
+    { "force", OPTION_CHOICE, &options.force_method, force_method_names, 0,
+      "All-pairs force method" },
+    { "tile-rows", OPTION_INT, &options.tile_rows, NULL, 1,
+      "Bodies receiving forces in each tile of the tiled method" },
+    { "tile-columns", OPTION_INT, &options.tile_columns, NULL, 1,
+      "Bodies exerting forces in each tile of the tiled method" },
+    { "precision", OPTION_CHOICE, &options.precision, precision_names, 0,
+      "Precision of force evaluation (mixed implies the tiled all-pairs method)" },
+    { "rsqrt-iterations", OPTION_INT, &options.rsqrt_iterations, NULL, 0,
+      "Newton-Raphson steps after a hardware reciprocal square root (0 for exact)" },
+    { "fixed-kernels", OPTION_CHOICE, &options.fixed_kernels, switch_names, 0,
+      "Use all-pairs kernels specialized for the body count when it is small" },
+    { "ensemble", OPTION_INT, &options.ensemble_size, NULL, 0,
+      "Copies of the system simulated together in vector lanes (Serial only; 0 for none)" },
+    { "threads", OPTION_INT, &options.threads, NULL, 0,
+      "Worker threads (0 for one per processor)" },
+    { "chunk-size", OPTION_INT, &options.chunk_size, NULL, 0,
+      "Objects in each work unit of the threaded programs (0 for one share per thread)" },
+    { "theta", OPTION_DOUBLE, &options.theta, NULL, 0,
+      "Barnes-Hut opening angle (larger is faster and less accurate)" },
+    { "leaf-size", OPTION_INT, &options.leaf_size, NULL, 1,
+      "Barnes-Hut cells with at most this many bodies are summed directly" },
+    { "tree-builder", OPTION_CHOICE, &options.tree_builder, tree_builder_names, 0,
+      "Build the Barnes-Hut octree by inserting bodies or from their sorted Morton keys" },
+    { "opening", OPTION_CHOICE, &options.opening, opening_names, 0,
+      "Open Barnes-Hut cells by the size of their region or the radius of their bodies" },
+    { "autotune", OPTION_CHOICE, &options.autotune, switch_names, 0,
+      "Benchmark the tunable options, save the best in the host's profile, and use them" },
+    { "profile", OPTION_CHOICE, &options.profile, switch_names, 0,
+      "Load the host's tuning profile (written by --autotune=on) if there is one" },
+    { "error-bound", OPTION_DOUBLE, &options.error_bound, NULL, 0,
+      "Largest approximation error accepted by the tuner (0 for that of the defaults)" },
+    { "integrator", OPTION_CHOICE, &options.integrator, integrator_names, 0,
+      "Method used to advance the simulation in time" },
+    { "block-levels", OPTION_INT, &options.block_levels, NULL, 0,
+      "Block steps are up to 2^levels times the base step (integrator=block)" },
+    { "step-accuracy", OPTION_POSITIVE, &options.step_accuracy, NULL, 0,
+      "Steps are at most this fraction of the dynamical time (adaptive or block steps)" },
+    { "ias15-epsilon", OPTION_DOUBLE, &options.ias15_epsilon, NULL, 0,
+      "Relative error allowed in each step (integrator=ias15; 0 for a fixed step)" },
+    { "time-step", OPTION_DOUBLE, &options.time_step, NULL, 1,
+      "Seconds in each step (the longest step when the step control is adaptive)" },
+    { "step-control", OPTION_CHOICE, &options.step_control, step_control_names, 0,
+      "Use fixed steps or choose each from the dynamical times of the objects" },
+    { "respa-steps", OPTION_INT, &options.respa_steps, NULL, 1,
+      "Steps with the near forces in each step with the far forces (integrator=respa)" },
+    { "near-radius", OPTION_DOUBLE, &options.near_radius, NULL, 0,
+      "Objects closer than this many AU exert near forces (integrator=respa)" },
+    { "list-skin", OPTION_DOUBLE, &options.list_skin, NULL, 0,
+      "Extra AU included in the near object lists so they are rebuilt less often" },
+    { "encounter-radius", OPTION_DOUBLE, &options.encounter_radius, NULL, 0,
+      "Objects closer than this many AU take substeps together (integrator=encounter)" },
+    { "encounter-substeps", OPTION_INT, &options.encounter_substeps, NULL, 1,
+      "Most substeps taken by the objects in encounters in each step (integrator=encounter)" },
+    { "parareal-iterations", OPTION_INT, &options.parareal_iterations, NULL, 0,
+      "Parareal iterations over one time slice per MPI node (0 to divide the objects)" },
+    { "parareal-coarse", OPTION_CHOICE, &options.parareal_coarse, integrator_names, 0,
+      "Method of the cheap Parareal propagator run across every time slice" },
+    { "parareal-coarse-step", OPTION_DOUBLE, &options.parareal_coarse_step, NULL, 1,
+      "Seconds in each step of the Parareal coarse propagator" },
+    { "parareal-tolerance", OPTION_DOUBLE, &options.parareal_tolerance, NULL, 0,
+      "Parareal stops when no position changes by more than this many AU" },
+    { "epochs", OPTION_TEXT, options.epochs, NULL, 0,
+      "File of times (seconds from the start) at which the state is interpolated and printed" },
+};
+
+// The name of the program (the last component of argv[0]) used in the profile name.
+PRIVATE char program_name[64] = "solarium";
+
+#define DESCRIPTOR_COUNT ( sizeof( descriptors ) / sizeof( descriptors[0] ) )
+
+
+PRIVATE int set_value( const struct OptionDescriptor *descriptor, const char *text )
+{
+    switch( descriptor->type ) {
+    case OPTION_CHOICE:
+        for( int i = 0; descriptor->choices[i] != NULL; ++i ) {
+            if( strcmp( text, descriptor->choices[i] ) == 0 ) {
+                *(int *)descriptor->value = i;
+                return 0;
+            }
+        }
+        break;
+
+    case OPTION_INT: {
+        char *end;
+        long  value = strtol( text, &end, 10 );
+
+        if( *text != '\0' && *end == '\0' &&
+            value >= descriptor->minimum && value <= 1000000000L ) {
+            *(int *)descriptor->value = (int)value;
+            return 0;
+        }
+        break;
+    }
+
+    case OPTION_DOUBLE:
+    case OPTION_POSITIVE: {
+        char  *end;
+        double value = strtod( text, &end );
+
+        if( *text != '\0' && *end == '\0' && value >= descriptor->minimum &&
+            ( descriptor->type != OPTION_POSITIVE || value > 0.0 ) ) {
+            *(double *)descriptor->value = value;
+            return 0;
+        }
+        break;
+    }
+
+    case OPTION_TEXT:
+        if( strlen( text ) < OPTION_TEXT_SIZE ) {
+            strcpy( (char *)descriptor->value, text );
+            return 0;
+        }
+        break;
+    }
+    return -1;
+}
+
+
+//! Return the descriptor of the option with the given name or NULL if there is none.
+PRIVATE const struct OptionDescriptor *find_descriptor( const char *name, size_t name_length )
+{
+    for( size_t i = 0; i < DESCRIPTOR_COUNT; ++i ) {
+        if( strlen( descriptors[i].name ) == name_length &&
+            strncmp( descriptors[i].name, name, name_length ) == 0 ) {
+            return &descriptors[i];
+        }
+    }
+    return NULL;
+}
+
+
+PRIVATE void print_value( FILE *output, const struct OptionDescriptor *descriptor )
+{
+    switch( descriptor->type ) {
+    case OPTION_CHOICE:
+        fprintf( output, "%s", descriptor->choices[*(int *)descriptor->value] );
+        break;
+
+    case OPTION_INT:
+        fprintf( output, "%d", *(int *)descriptor->value );
+        break;
+
+    case OPTION_DOUBLE:
+    case OPTION_POSITIVE:
+        fprintf( output, "%g", *(double *)descriptor->value );
+        break;
+
+    case OPTION_TEXT:
+        fprintf( output, "%s", (const char *)descriptor->value );
+        break;
+    }
+}
+
+
+//! Apply the options on the command line. Other arguments are ignored.
+PRIVATE int parse_arguments( int argc, char **argv )
+{
+    int status = 0;
+
+    for( int i = 1; i < argc; ++i ) {
+        const char *argument = argv[i];
+        const char *equals;
+        const struct OptionDescriptor *descriptor;
+
+        if( strncmp( argument, "--", 2 ) != 0 ) continue;
+        argument += 2;
+        if( ( equals = strchr( argument, '=' ) ) == NULL ) {
+            fprintf( stderr, "Option --%s requires a value (--name=value)\n", argument );
+            status = -1;
+            continue;
+        }
+        if( ( descriptor = find_descriptor( argument, equals - argument ) ) == NULL ) {
+            fprintf( stderr, "Unknown option --%.*s\n", (int)( equals - argument ), argument );
+            status = -1;
+        }
+        else if( set_value( descriptor, equals + 1 ) != 0 ) {
+            fprintf( stderr, "Invalid value for option --%s\n", descriptor->name );
+            status = -1;
+        }
+    }
+    return status;
+}
+
+
+PUBLIC int Options_parse( int argc, char **argv )
+{
+    FILE *profile;
+
+    if( argc > 0 ) {
+        const char *slash = strrchr( argv[0], '/' );
+        snprintf( program_name, sizeof( program_name ), "%s", slash ? slash + 1 : argv[0] );
+    }
+
+    // The command line decides whether the profile is used. It is applied a second time so that
+    // its settings take precedence over those in the profile.
+    if( parse_arguments( argc, argv ) != 0 ) return -1;
+    if( options.profile && !options.autotune &&
+        ( profile = fopen( Options_profile_path( ), "r" ) ) != NULL ) {
+        int status = Options_read( profile );
+
+        fclose( profile );
+        if( status != 0 ) {
+            fprintf( stderr, "Invalid tuning profile %s\n", Options_profile_path( ) );
+            return -1;
+        }
+        fprintf( stderr, "Loaded tuning profile %s\n", Options_profile_path( ) );
+        parse_arguments( argc, argv );
+    }
+    return 0;
+}
+
+
+PUBLIC void Options_usage( FILE *output )
+{
+    fprintf( output, "Options (current value in brackets):\n" );
+    for( size_t i = 0; i < DESCRIPTOR_COUNT; ++i ) {
+        fprintf( output, "  --%s=", descriptors[i].name );
+        if( descriptors[i].type == OPTION_CHOICE ) {
+            for( int j = 0; descriptors[i].choices[j] != NULL; ++j ) {
+                fprintf( output, "%s%s", ( j == 0 ) ? "" : "|", descriptors[i].choices[j] );
+            }
+        }
+        else if( descriptors[i].type == OPTION_DOUBLE ||
+                 descriptors[i].type == OPTION_POSITIVE ) {
+            fprintf( output, "X" );
+        }
+        else if( descriptors[i].type == OPTION_TEXT ) {
+            fprintf( output, "TEXT" );
+        }
+        else {
+            fprintf( output, "N" );
+        }
+        fprintf( output, "\n      %s [", descriptors[i].help );
+        print_value( output, &descriptors[i] );
+        fprintf( output, "]\n" );
+    }
+}
+
+
+PUBLIC int Options_set( const char *name, const char *value )
+{
+    const struct OptionDescriptor *descriptor = find_descriptor( name, strlen( name ) );
+
+    if( descriptor == NULL ) return -1;
+    return set_value( descriptor, value );
+}
+
+
+PUBLIC int Options_get( const char *name, char *buffer, size_t size )
+{
+    const struct OptionDescriptor *descriptor = find_descriptor( name, strlen( name ) );
+
+    if( descriptor == NULL ) return -1;
+    switch( descriptor->type ) {
+    case OPTION_CHOICE:
+        snprintf( buffer, size, "%s", descriptor->choices[*(int *)descriptor->value] );
+        break;
+
+    case OPTION_INT:
+        snprintf( buffer, size, "%d", *(int *)descriptor->value );
+        break;
+
+    case OPTION_DOUBLE:
+    case OPTION_POSITIVE:
+        snprintf( buffer, size, "%g", *(double *)descriptor->value );
+        break;
+
+    case OPTION_TEXT:
+        snprintf( buffer, size, "%s", (const char *)descriptor->value );
+        break;
+    }
+    return 0;
+}
+
+
+PUBLIC void Options_write( FILE *output, const char *const *names )
+{
+    for( int i = 0; names[i] != NULL; ++i ) {
+        const struct OptionDescriptor *descriptor =
+            find_descriptor( names[i], strlen( names[i] ) );
+
+        if( descriptor == NULL ) continue;
+        fprintf( output, "%s=", descriptor->name );
+        print_value( output, descriptor );
+        fprintf( output, "\n" );
+    }
+}
+
+
+PUBLIC int Options_read( FILE *input )
+{
+    char line[256];
+    int  status = 0;
+
+    while( fgets( line, sizeof( line ), input ) != NULL ) {
+        char *equals;
+
+        line[strcspn( line, "\r\n" )] = '\0';
+        if( line[0] == '\0' || line[0] == '#' ) continue;
+        if( ( equals = strchr( line, '=' ) ) == NULL ) {
+            status = -1;
+            continue;
+        }
+        *equals = '\0';
+        if( Options_set( line, equals + 1 ) != 0 ) status = -1;
+    }
+    return status;
+}
+
+
+PUBLIC const char *Options_profile_path( void )
+{
+    static char path[1024];
+    char        host_name[256] = "localhost";
+    const char *directory      = getenv( "SOLARIUM_PROFILE_DIR" );
+    const char *home           = getenv( "HOME" );
+
+    gethostname( host_name, sizeof( host_name ) );
+    host_name[sizeof( host_name ) - 1] = '\0';
+    if( directory != NULL ) {
+        snprintf( path, sizeof( path ), "%s/%s-%s-%d.profile",
+                  directory, host_name, program_name, OBJECT_COUNT );
+    }
+    else {
+        snprintf( path, sizeof( path ), "%s/.solarium/%s-%s-%d.profile",
+                  ( home != NULL ) ? home : ".", host_name, program_name, OBJECT_COUNT );
+    }
+    return path;
+}
+
+
+PUBLIC int Options_thread_count( void )
+{
+    if( options.threads > 0 ) return options.threads;
+
+    #if defined(__GLIBC__) || defined(__CYGWIN__)
+    return get_nprocs( );
+    #elif defined(__APPLE__)
+    return get_macOS_nprocs( );
+    #else
+    return (int)sysconf( _SC_NPROCESSORS_ONLN );
+    #endif
+}
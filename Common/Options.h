@@ -0,0 +1,160 @@
+/*! \file    Options.h
+ *  \brief   Run time options shared by the simulator programs.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The constants in global.h fix the problem being solved. The options here select how it is
+ * solved. They have sensible defaults and can be changed on the command line of any program
+ * that calls Options_parse using arguments of the form --name=value.
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>
+
+//! The size of the buffers holding text options, including the terminating null character.
+#define OPTION_TEXT_SIZE 256
+
+//! The methods for computing all-pairs forces.
+enum ForceMethod {
+    FORCE_DIRECT,      //!< Each body sums the forces due to all other bodies.
+    FORCE_SYMMETRIC,   //!< Each pair is visited once; equal and opposite forces are applied.
+    FORCE_TILED        //!< As FORCE_DIRECT but blocked so bodies are reused from cache.
+};
+
+//! The precisions in which forces can be evaluated.
+enum Precision {
+    PRECISION_DOUBLE,  //!< Everything is computed in double precision.
+    PRECISION_MIXED    //!< Pair interactions in single precision, sums in double precision.
+};
+
+//! The methods for advancing the simulation in time (see Integrator.h).
+enum IntegratorMethod {
+    INTEGRATOR_EULER,     //!< First order. Positions are advanced with the old velocities.
+    INTEGRATOR_LEAPFROG,  //!< Second order symplectic kick-drift-kick.
+    INTEGRATOR_HERMITE,   //!< Fourth order predictor-corrector using the jerks.
+    INTEGRATOR_BLOCK,     //!< Leapfrog with individual power of two time steps.
+    INTEGRATOR_WISDOM_HOLMAN, //!< Kepler orbits about the sun with kicks from the planets.
+    INTEGRATOR_IAS15,     //!< Adaptive 15th order Gauss-Radau steps (see IAS15.h).
+    INTEGRATOR_RESPA,     //!< Leapfrog with the forces of near objects applied more often.
+    INTEGRATOR_YOSHIDA4,  //!< Fourth order composition of three leapfrog steps.
+    INTEGRATOR_YOSHIDA6,  //!< Sixth order composition of seven leapfrog steps.
+    INTEGRATOR_ENCOUNTER  //!< Leapfrog with substeps for the objects in close encounters.
+};
+
+//! How the Barnes-Hut octree is built.
+enum TreeBuilder {
+    TREE_INSERT,      //!< The bodies are inserted into the tree by all threads at once.
+    TREE_MORTON       //!< The bodies are sorted by Morton key and the tree built in parallel.
+};
+
+//! How Barnes-Hut cells are judged far enough away to be treated as a single body.
+enum OpeningCriterion {
+    OPENING_SIZE,     //!< The largest side of the cell's region is compared with the distance.
+    OPENING_RADIUS    //!< The diameter of the sphere holding the cell's bodies is used instead.
+};
+
+//! How the length of each step is chosen (see Integrator_choose_step).
+enum StepControl {
+    STEP_FIXED,       //!< Every step is options.time_step seconds.
+    STEP_ADAPTIVE     //!< Each step is a fraction of the shortest dynamical time.
+};
+
+//! Structure that holds the run time options.
+typedef struct {
+    enum ForceMethod force_method;    //!< How all-pairs forces are computed.
+    int tile_rows;                    //!< Bodies receiving forces per tile (FORCE_TILED).
+    int tile_columns;                 //!< Bodies exerting forces per tile (FORCE_TILED).
+    enum Precision precision;         //!< Precision of the force evaluation.
+    int rsqrt_iterations;             //!< Newton steps refining hardware rsqrt (0 = exact).
+    int fixed_kernels;                //!< Nonzero to use kernels specialized for small counts.
+    int ensemble_size;                //!< Simulations advanced together (0 = ensemble unused).
+    int threads;                      //!< Worker threads (0 = one per processor).
+    int chunk_size;                   //!< Bodies per work unit (0 = an even division).
+    double theta;                     //!< Barnes-Hut opening angle.
+    int leaf_size;                    //!< Barnes-Hut cells this small are summed directly.
+    enum TreeBuilder tree_builder;    //!< How the Barnes-Hut octree is built.
+    enum OpeningCriterion opening;    //!< How Barnes-Hut cells are judged far enough away.
+    int autotune;                     //!< Nonzero to tune the options before the simulation.
+    int profile;                      //!< Nonzero to load the host's tuning profile.
+    double error_bound;               //!< Largest error allowed while tuning (0 = untuned).
+    enum IntegratorMethod integrator; //!< How the simulation is advanced in time.
+    int block_levels;                 //!< Largest step is 2^block_levels base steps.
+    double step_accuracy;             //!< Fraction of the dynamical time allowed as a step.
+    double time_step;                 //!< Seconds in a step (the longest if it is adaptive).
+    enum StepControl step_control;    //!< How the length of each step is chosen.
+    int respa_steps;                  //!< Near force steps in each far force step.
+    double near_radius;               //!< Objects closer than this (AU) interact as near.
+    double list_skin;                 //!< Margin (AU) of the near object lists.
+    double encounter_radius;          //!< Objects closer than this (AU) are in an encounter.
+    int encounter_substeps;           //!< Most substeps of the encounters in each step.
+    double ias15_epsilon;             //!< Relative error allowed in each IAS15 step.
+    int parareal_iterations;          //!< Parareal iterations across MPI nodes (0 = unused).
+    enum IntegratorMethod parareal_coarse; //!< The method of the Parareal coarse propagator.
+    double parareal_coarse_step;      //!< Seconds in a step of the coarse propagator.
+    double parareal_tolerance;        //!< Parareal stops when no position changes more (AU).
+    char epochs[OPTION_TEXT_SIZE];    //!< File of times to print the state at ("" for none).
+} Options;
+
+//! The options in effect. Programs may also set these directly before the simulation starts.
+extern Options options;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Update the options from the command line.
+/*!
+ * Arguments that do not start with "--" are ignored so that programs can use them for other
+ * purposes. An error message is printed to stderr for an unknown option or an invalid value.
+ *
+ * \return Zero if all options were processed or -1 if there was an error.
+ */
+int Options_parse( int argc, char **argv );
+
+//! Print a description of the available options and their current values.
+void Options_usage( FILE *output );
+
+//! Set the option named 'name' from the text of its value.
+/*!
+ * \return Zero if successful or -1 if there is no such option or the value is invalid.
+ */
+int Options_set( const char *name, const char *value );
+
+//! Put the text of the value of the option named 'name' into 'buffer'.
+/*!
+ * \return Zero if successful or -1 if there is no such option.
+ */
+int Options_get( const char *name, char *buffer, size_t size );
+
+//! Write the named options to 'output', one per line, in the form name=value.
+/*!
+ * \param names A NULL terminated list of option names. Unknown names are skipped.
+ */
+void Options_write( FILE *output, const char *const *names );
+
+//! Set options from lines of the form name=value. Blank lines and lines starting with # are
+//! ignored.
+/*!
+ * \return Zero if all lines were processed or -1 if there was an error.
+ */
+int Options_read( FILE *input );
+
+//! Return the path of the tuning profile for this program on this host.
+/*!
+ * Profiles are kept in the directory named by the SOLARIUM_PROFILE_DIR environment variable or,
+ * if it is not set, in $HOME/.solarium. The profile name includes the host name, the program
+ * name (from the argv[0] given to Options_parse), and OBJECT_COUNT since the best settings
+ * depend on all three. Options_parse loads the profile, if there is one and options.profile is
+ * set, before applying the command line. The returned string is in static storage.
+ */
+const char *Options_profile_path( void );
+
+//! Return options.threads if it is set, otherwise the number of processors.
+int Options_thread_count( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
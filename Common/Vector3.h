@@ -1,11 +1,35 @@
 /*! \file    Vector3.h
  *  \brief   Handling of three-dimensional vectors.
  *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * The vector operations are small enough that the cost of calling them is comparable to the
+ * cost of the arithmetic they do, and calls into the library can't be inlined or vectorized by
+ * the compiler. They are therefore defined here as static inline functions.
+ *
+ * When VECTOR3_SIMD is defined (for example by adding -DVECTOR3_SIMD to the compiler flags of
+ * every module) each vector is padded to four components so that it can be loaded into one AVX
+ * register (when compiling with -mavx or similar) or a pair of SSE2 registers. The operations
+ * then work on all components at once. The padding component has
+ * no meaning and its value is unspecified. The x, y, and z members are available in both
+ * representations so programs need not be aware of which one is in use. However, the size of
+ * the structure differs so all modules of a program must agree on the setting.
  */
 
 #ifndef VECTOR3_H
 #define VECTOR3_H
 
+#if defined(VECTOR3_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#elif defined(VECTOR3_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef VECTOR3_SIMD
+#define VECTOR3_ALIGNMENT __attribute__(( aligned( 16 ) ))
+#else
+#define VECTOR3_ALIGNMENT
+#endif
+
 //! Structure that represents a three-dimensional vector.
 /*!
  *  This structure simplifies vector computations by encapsulating the handling of the vector's
@@ -15,21 +39,130 @@ typedef struct {
 	double x;
 	double y;
 	double z;
-} Vector3;
-
-#ifdef __cplusplus
-extern "C" {
+#ifdef VECTOR3_SIMD
+	double padding;
 #endif
+} VECTOR3_ALIGNMENT Vector3;
 
-Vector3 v3_add( Vector3 a, Vector3 b );
-Vector3 v3_subtract( Vector3 a, Vector3 b );
-Vector3 v3_multiply( double scale_factor, Vector3 a );
-Vector3 v3_divide( Vector3 a, double scale_factor );
+#if defined(VECTOR3_SIMD) && defined(__AVX__)
 
-double magnitude_squared( Vector3 a );
+// Vectors are only aligned on 16 byte boundaries (as guaranteed by malloc) so unaligned loads
+// and stores are used. They are as fast as aligned ones unless the data crosses a cache line.
+
+static inline Vector3 v3_add( Vector3 a, Vector3 b )
+{
+	Vector3 result;
+	_mm256_storeu_pd(
+		&result.x, _mm256_add_pd( _mm256_loadu_pd( &a.x ), _mm256_loadu_pd( &b.x ) ) );
+	return result;
+}
+
+static inline Vector3 v3_subtract( Vector3 a, Vector3 b )
+{
+	Vector3 result;
+	_mm256_storeu_pd(
+		&result.x, _mm256_sub_pd( _mm256_loadu_pd( &a.x ), _mm256_loadu_pd( &b.x ) ) );
+	return result;
+}
+
+static inline Vector3 v3_multiply( double scale_factor, Vector3 a )
+{
+	Vector3 result;
+	_mm256_storeu_pd(
+		&result.x, _mm256_mul_pd( _mm256_set1_pd( scale_factor ), _mm256_loadu_pd( &a.x ) ) );
+	return result;
+}
+
+static inline Vector3 v3_divide( Vector3 a, double scale_factor )
+{
+	Vector3 result;
+	_mm256_storeu_pd(
+		&result.x, _mm256_div_pd( _mm256_loadu_pd( &a.x ), _mm256_set1_pd( scale_factor ) ) );
+	return result;
+}
+
+#elif defined(VECTOR3_SIMD) && defined(__SSE2__)
+
+// The x and y components are in one register and z and the padding are in the other.
+
+static inline Vector3 v3_add( Vector3 a, Vector3 b )
+{
+	Vector3 result;
+	_mm_store_pd( &result.x, _mm_add_pd( _mm_load_pd( &a.x ), _mm_load_pd( &b.x ) ) );
+	_mm_store_pd( &result.z, _mm_add_pd( _mm_load_pd( &a.z ), _mm_load_pd( &b.z ) ) );
+	return result;
+}
 
-#ifdef __cplusplus
+static inline Vector3 v3_subtract( Vector3 a, Vector3 b )
+{
+	Vector3 result;
+	_mm_store_pd( &result.x, _mm_sub_pd( _mm_load_pd( &a.x ), _mm_load_pd( &b.x ) ) );
+	_mm_store_pd( &result.z, _mm_sub_pd( _mm_load_pd( &a.z ), _mm_load_pd( &b.z ) ) );
+	return result;
 }
+
+static inline Vector3 v3_multiply( double scale_factor, Vector3 a )
+{
+	Vector3 result;
+	__m128d scale = _mm_set1_pd( scale_factor );
+	_mm_store_pd( &result.x, _mm_mul_pd( scale, _mm_load_pd( &a.x ) ) );
+	_mm_store_pd( &result.z, _mm_mul_pd( scale, _mm_load_pd( &a.z ) ) );
+	return result;
+}
+
+static inline Vector3 v3_divide( Vector3 a, double scale_factor )
+{
+	Vector3 result;
+	__m128d scale = _mm_set1_pd( scale_factor );
+	_mm_store_pd( &result.x, _mm_div_pd( _mm_load_pd( &a.x ), scale ) );
+	_mm_store_pd( &result.z, _mm_div_pd( _mm_load_pd( &a.z ), scale ) );
+	return result;
+}
+
+#else
+
+static inline Vector3 v3_add( Vector3 a, Vector3 b )
+{
+	Vector3 result;
+	result.x = a.x + b.x;
+	result.y = a.y + b.y;
+	result.z = a.z + b.z;
+	return result;
+}
+
+static inline Vector3 v3_subtract( Vector3 a, Vector3 b )
+{
+	Vector3 result;
+	result.x = a.x - b.x;
+	result.y = a.y - b.y;
+	result.z = a.z - b.z;
+	return result;
+}
+
+static inline Vector3 v3_multiply( double scale_factor, Vector3 a )
+{
+	Vector3 result = a;
+	result.x *= scale_factor;
+	result.y *= scale_factor;
+	result.z *= scale_factor;
+	return result;
+}
+
+static inline Vector3 v3_divide( Vector3 a, double scale_factor )
+{
+	Vector3 result = a;
+	result.x /= scale_factor;
+	result.y /= scale_factor;
+	result.z /= scale_factor;
+	return result;
+}
+
 #endif
 
+// The padding component (if any) must not contribute to the magnitude.
+static inline double magnitude_squared( Vector3 a )
+{
+	return (a.x * a.x) + (a.y * a.y) + (a.z * a.z);
+}
+
 #endif
@@ -19,7 +19,7 @@ int get_macOS_nprocs( void );
 #define AU               1.49597870700E+11  // Meters per astronomical unit.
 #define AVERAGE_VELOCITY 2.9785E+3   // Meters per second (used during random initialization).
 #define G                6.673E-11   // Gravitational constant.
-#define TIME_STEP        3.6E+03     // Seconds in a time step (one hour).
+#define TIME_STEP        3.6E+03     // Default seconds in a time step (one hour).
 // The AVERAGE_VELOCITY above is 1/10 the magnitude of the velocity of Earth in its orbit.
 
 //! Structure that represents the position and velocity of a particular object.
@@ -33,10 +33,12 @@ typedef struct {
 
 //! Structure that represents an individual object.
 /*!
- * This class defines the object's unchanging mass.
+ * This class defines the object's unchanging mass. The force computations use the object's
+ * gravitational parameter, G times the mass, which is computed once during initialization.
  */
 typedef struct {
     double mass;
+    double mu;
 } Object;
 
 // Three arrays are used to hold object information. These arrays are indexed by an integer
@@ -50,11 +52,14 @@ extern ObjectDynamics *next_dynamics;
 
 //! Compute the next dynamics from the current dynamics.
 /*!
- * This function takes one step of simulated time using the value of TIME_STEP as the step size.
- * It updates the next dynamics array and swaps the array so that when it returns the updated
- * state of the system is in current_dynamics.
+ * This function takes one step of simulated time. The step is options.time_step seconds or, if
+ * options.step_control is STEP_ADAPTIVE, a step chosen from the state of the system, but never
+ * more than 'maximum' seconds. It updates the next dynamics array and swaps the array so that
+ * when it returns the updated state of the system is in current_dynamics.
+ *
+ * \return The length of the step in seconds.
  */
-void time_step( );
+double time_step( double maximum );
 
 
 //! Print the current dynamics.
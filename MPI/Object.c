@@ -10,32 +10,24 @@
 #include <mpi.h>
 
 #include "global.h"
+#include "AllPairs.h"
+#include "BodyStore.h"
+#include "Integrator.h"
+#include "Options.h"
+#include "Parareal.h"
 
-void CPU_work_unit( int start_index, int stop_index )
+void CPU_work_unit( int start_index, int stop_index, double step )
 {
     // For each object...
     #pragma omp parallel for
     for( int object_i = start_index; object_i < stop_index; ++object_i ) {
-        Vector3 total_force = { 0.0, 0.0, 0.0 };
-
         // Consider interactions with all other objects...
-        for( int object_j = 0; object_j < OBJECT_COUNT; ++object_j ) {
-            if( object_i == object_j ) continue;
-
-            Vector3 displacement = v3_subtract(
-                current_dynamics[object_j].position, current_dynamics[object_i].position );
-            double distance_squared = magnitude_squared( displacement );
-            double distance = sqrt( distance_squared );
-            double force_magnitude =
-                ( G * object_array[object_i].mass * object_array[object_j].mass ) / distance_squared;
-            Vector3 force = v3_multiply( (force_magnitude / distance ), displacement );
-            total_force = v3_add( total_force, force );
-        }
+        AllPairs_forces( &body_store, object_i, object_i + 1 );
 
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass);
-        Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
-        Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
+        // The acceleration of object_i is now known. Compute velocity and position.
+        Vector3 acceleration   = BodyStore_acceleration( &body_store, object_i );
+        Vector3 delta_v        = v3_multiply( step, acceleration );
+        Vector3 delta_position = v3_multiply( step, current_dynamics[object_i].velocity );
 
         next_dynamics[object_i].velocity =
             v3_add( current_dynamics[object_i].velocity, delta_v );
@@ -46,34 +38,156 @@ void CPU_work_unit( int start_index, int stop_index )
 }
 
 
-// WARNING: This is horrible!
-// Break the abstraction of Vector3 so we can explain to MPI the layout of this structure.
-struct HorrifyingHack {
-   double position[3];
-   double velocity[3];
-};
-
-
-// Explain to MPI about the StarDynamics structure.
+// Explain to MPI about the ObjectDynamics structure.
+// Only the x, y, and z components of each vector are described. When Vector3 is padded for SIMD
+// (see Vector3.h) the padding is not sent and the extent is stretched to cover it.
 void build_MPI_dynamics_type( MPI_Datatype *type )
 {
     int          block_lengths[2];
     MPI_Aint     offsets[2];
     MPI_Datatype types[2];
+    MPI_Datatype packed_type;
 
     block_lengths[0] = 3;
     block_lengths[1] = 3;
-    offsets[0] = offsetof( struct HorrifyingHack, position );
-    offsets[1] = offsetof( struct HorrifyingHack, velocity );
+    offsets[0] = offsetof( ObjectDynamics, position );
+    offsets[1] = offsetof( ObjectDynamics, velocity );
     types[0]   = MPI_DOUBLE;
     types[1]   = MPI_DOUBLE;
 
-    MPI_Type_create_struct( 2, block_lengths, offsets, types, type );
+    MPI_Type_create_struct( 2, block_lengths, offsets, types, &packed_type );
+    MPI_Type_create_resized( packed_type, 0, sizeof( ObjectDynamics ), type );
+    MPI_Type_free( &packed_type );
 }
 
 
-void time_step( )
+// Explain to MPI about the Vector3 structure. The padding (if any) is not sent.
+void build_MPI_vector_type( MPI_Datatype *type )
+{
+    MPI_Datatype packed_type;
+
+    MPI_Type_contiguous( 3, MPI_DOUBLE, &packed_type );
+    MPI_Type_create_resized( packed_type, 0, sizeof( Vector3 ), type );
+    MPI_Type_free( &packed_type );
+}
+
+
+// Compute the accelerations of all objects at the positions in 'dynamics'. Each node of
+// 'communicator' computes a share of them and the shares are then exchanged so every node has
+// all the accelerations.
+static void shared_accelerations( MPI_Comm communicator,
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
 {
+    int number_of_nodes;
+    int my_rank;
+    MPI_Datatype vector_type;
+
+    MPI_Comm_size( communicator, &number_of_nodes );
+    MPI_Comm_rank( communicator, &my_rank );
+    build_MPI_vector_type( &vector_type );
+    MPI_Type_commit( &vector_type );
+
+    int *counts  = (int *)malloc( number_of_nodes * sizeof(int) );
+    int *offsets = (int *)malloc( number_of_nodes * sizeof(int) );
+    for( int node = 0; node < number_of_nodes; ++node ) {
+        counts[node]  = OBJECT_COUNT / number_of_nodes;
+        offsets[node] = node * counts[node];
+    }
+    counts[number_of_nodes - 1] += OBJECT_COUNT % number_of_nodes;
+
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    int start_index = offsets[my_rank];
+    int end_index   = start_index + counts[my_rank];
+
+    // The Hermite kernels compute a whole block of rows at once so the objects are handed out
+    // in blocks of that size.
+    #pragma omp parallel for
+    for( int block = start_index; block < end_index; block += BODYSTORE_PADDING ) {
+        int block_end = ( end_index - block < BODYSTORE_PADDING ) ?
+            end_index : block + BODYSTORE_PADDING;
+
+        AllPairs_forces( &body_store, block, block_end );
+        for( int object_i = block; object_i < block_end; ++object_i ) {
+            accelerations[object_i] = BodyStore_acceleration( &body_store, object_i );
+            if( jerks != NULL ) jerks[object_i] = BodyStore_jerk( &body_store, object_i );
+        }
+    }
+
+    MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                    accelerations, counts, offsets, vector_type, communicator );
+    if( jerks != NULL ) {
+        MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                        jerks, counts, offsets, vector_type, communicator );
+    }
+    MPI_Type_free( &vector_type );
+    free( counts );
+    free( offsets );
+}
+
+
+void compute_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
+{
+    shared_accelerations( MPI_COMM_WORLD, dynamics, accelerations, jerks );
+}
+
+
+void local_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
+{
+    shared_accelerations( MPI_COMM_SELF, dynamics, accelerations, jerks );
+}
+
+
+// Compute the accelerations of the active objects at the positions in 'dynamics'. Every node
+// has the same list of active objects. Each computes a share of the list and the shares are
+// exchanged in the order of the list.
+void compute_active_accelerations( const ObjectDynamics *dynamics,
+    const int *active, int active_count, Vector3 *accelerations )
+{
+    int number_of_nodes;
+    int my_rank;
+    MPI_Datatype vector_type;
+
+    MPI_Comm_size( MPI_COMM_WORLD, &number_of_nodes );
+    MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
+    build_MPI_vector_type( &vector_type );
+    MPI_Type_commit( &vector_type );
+
+    int *counts  = (int *)malloc( number_of_nodes * sizeof(int) );
+    int *offsets = (int *)malloc( number_of_nodes * sizeof(int) );
+    Vector3 *active_accelerations = (Vector3 *)malloc( active_count * sizeof(Vector3) );
+    for( int node = 0; node < number_of_nodes; ++node ) {
+        offsets[node] = (int)( (long long)active_count * node / number_of_nodes );
+        counts[node]  = (int)( (long long)active_count * ( node + 1 ) / number_of_nodes ) -
+            offsets[node];
+    }
+
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    int start_index = offsets[my_rank];
+    int end_index   = start_index + counts[my_rank];
+
+    #pragma omp parallel for
+    for( int i = start_index; i < end_index; ++i ) {
+        AllPairs_forces( &body_store, active[i], active[i] + 1 );
+        active_accelerations[i] = BodyStore_acceleration( &body_store, active[i] );
+    }
+
+    MPI_Allgatherv( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                    active_accelerations, counts, offsets, vector_type, MPI_COMM_WORLD );
+    for( int i = 0; i < active_count; ++i ) {
+        accelerations[active[i]] = active_accelerations[i];
+    }
+    MPI_Type_free( &vector_type );
+    free( active_accelerations );
+    free( counts );
+    free( offsets );
+}
+
+
+double time_step( double maximum )
+{
+    double step = ( options.time_step < maximum ) ? options.time_step : maximum;
     int number_of_nodes;
     int my_rank;
     MPI_Datatype dynamics_type;
@@ -85,6 +199,38 @@ void time_step( )
 
     MPI_Bcast( current_dynamics, OBJECT_COUNT, dynamics_type, 0, MPI_COMM_WORLD );
 
+    // Every node then takes the same step with the same accelerations so the nodes stay in
+    // agreement. Only the first broadcast is needed but it is cheap compared with the forces.
+    // An adaptive step is chosen from the same data so the nodes agree on it too. Every block
+    // step must have the same base step (see Integrator_block_step) so it is not shortened to
+    // fit 'maximum'.
+    if( options.integrator == INTEGRATOR_BLOCK ) {
+        step = options.time_step;
+        MPI_Type_free( &dynamics_type );
+        if( Integrator_block_step( compute_active_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+        }
+        return step;
+    }
+    if( options.step_control == STEP_ADAPTIVE ) {
+        step = Integrator_choose_step( compute_accelerations, step );
+        if( step < 0.0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+        }
+    }
+    if( options.integrator != INTEGRATOR_EULER || options.step_control == STEP_ADAPTIVE ) {
+        MPI_Type_free( &dynamics_type );
+        if( Integrator_step( compute_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+        }
+        return step;
+    }
+
+    BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+
     // How many objects is each MPI node handling?
     int objects_per_node = OBJECT_COUNT / number_of_nodes;
     int my_object_count  = objects_per_node;
@@ -96,7 +242,7 @@ void time_step( )
     int start_index = my_rank * objects_per_node;
     int end_index = start_index + my_object_count;
 
-    CPU_work_unit( start_index, end_index );
+    CPU_work_unit( start_index, end_index, step );
 
     // Bring together the results into the master's current_dynamics array.
     ObjectDynamics *src = &next_dynamics[start_index];
@@ -115,6 +261,7 @@ void time_step( )
     // ObjectDynamics *temp = current_dynamics;
     // current_dynamics     = next_dynamics;
     // next_dynamics        = temp;
+    return step;
 }
 
 
@@ -0,0 +1,199 @@
+/*! \file    Parareal.c
+ *  \brief   Implementation of the time parallel Parareal integration.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Integrator.h"
+#include "Options.h"
+#include "Parareal.h"
+
+#define PRIVATE static
+#define PUBLIC
+
+#define STATE_SIZE ( OBJECT_COUNT * sizeof(ObjectDynamics) )
+
+
+//! Advance 'start' by 'duration' seconds into 'end' on this node alone.
+/*!
+ * The integrator works on current_dynamics with the options in effect. Both are switched to
+ * those of the propagator for the duration of the call and then restored.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+PRIVATE int propagate( enum IntegratorMethod method, double step, enum StepControl control,
+                       const ObjectDynamics *start, ObjectDynamics *end, double duration )
+{
+    enum IntegratorMethod saved_method   = options.integrator;
+    enum StepControl      saved_control  = options.step_control;
+    ObjectDynamics       *saved_dynamics = current_dynamics;
+    double                elapsed        = 0.0;
+    int                   status         = 0;
+
+    memcpy( end, start, STATE_SIZE );
+    current_dynamics     = end;
+    options.integrator   = method;
+    options.step_control = control;
+    Integrator_reset( );
+
+    while( status == 0 && elapsed < duration ) {
+        double this_step = ( step < duration - elapsed ) ? step : duration - elapsed;
+
+        if( control == STEP_ADAPTIVE ) {
+            this_step = Integrator_choose_step( local_accelerations, this_step );
+            if( this_step < 0.0 ) {
+                status = -1;
+                break;
+            }
+        }
+        status   = Integrator_step( local_accelerations, this_step );
+        elapsed += this_step;
+    }
+
+    current_dynamics     = saved_dynamics;
+    options.integrator   = saved_method;
+    options.step_control = saved_control;
+    Integrator_reset( );
+    return status;
+}
+
+
+//! Advance 'start' by 'duration' seconds into 'end' with the coarse propagator.
+PRIVATE int coarse( const ObjectDynamics *start, ObjectDynamics *end, double duration )
+{
+    return propagate( options.parareal_coarse, options.parareal_coarse_step, STEP_FIXED,
+                      start, end, duration );
+}
+
+
+//! Advance 'start' by 'duration' seconds into 'end' with the fine propagator.
+PRIVATE int fine( const ObjectDynamics *start, ObjectDynamics *end, double duration )
+{
+    return propagate( options.integrator, options.time_step, options.step_control,
+                      start, end, duration );
+}
+
+
+//! Return the largest distance in AU between the positions of an object in 'a' and in 'b'.
+PRIVATE double largest_change( const ObjectDynamics *a, const ObjectDynamics *b )
+{
+    double largest = 0.0;
+
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        double change =
+            magnitude_squared( v3_subtract( a[object_i].position, b[object_i].position ) );
+        if( change > largest ) largest = change;
+    }
+    return sqrt( largest ) / AU;
+}
+
+
+PUBLIC int Parareal_advance( double duration )
+{
+    int number_of_nodes;
+    int my_rank;
+    int status = 0;
+    MPI_Datatype dynamics_type;
+
+    MPI_Comm_size( MPI_COMM_WORLD, &number_of_nodes );
+    MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
+    build_MPI_dynamics_type( &dynamics_type );
+    MPI_Type_commit( &dynamics_type );
+
+    double slice = duration / number_of_nodes;
+
+    // states[n] is the estimate of the state at the start of slice n. coarse_ends[n] and
+    // fine_ends[n] are the results of the two propagators across slice n from that estimate.
+    size_t          count       = (size_t)number_of_nodes;
+    ObjectDynamics *states      = (ObjectDynamics *)malloc( ( count + 1 ) * STATE_SIZE );
+    ObjectDynamics *coarse_ends = (ObjectDynamics *)malloc( count * STATE_SIZE );
+    ObjectDynamics *fine_ends   = (ObjectDynamics *)malloc( count * STATE_SIZE );
+    ObjectDynamics *corrected   = (ObjectDynamics *)malloc( STATE_SIZE );
+    if( states == NULL || coarse_ends == NULL || fine_ends == NULL || corrected == NULL ) {
+        MPI_Type_free( &dynamics_type );
+        free( states );
+        free( coarse_ends );
+        free( fine_ends );
+        free( corrected );
+        return -1;
+    }
+
+    // Every node starts from the master's state and computes the same coarse estimates.
+    MPI_Bcast( current_dynamics, OBJECT_COUNT, dynamics_type, 0, MPI_COMM_WORLD );
+    memcpy( &states[0], current_dynamics, STATE_SIZE );
+    for( int n = 0; n < number_of_nodes; ++n ) {
+        ObjectDynamics *coarse_end = &coarse_ends[n * OBJECT_COUNT];
+
+        if( coarse( &states[n * OBJECT_COUNT], coarse_end, slice ) != 0 ) {
+            status = -1;
+            break;
+        }
+        memcpy( &states[( n + 1 ) * OBJECT_COUNT], coarse_end, STATE_SIZE );
+    }
+
+    // After as many iterations as there are slices the result is exact. More do nothing.
+    int iterations = ( options.parareal_iterations < number_of_nodes ) ?
+        options.parareal_iterations : number_of_nodes;
+
+    for( int iteration = 1; status == 0 && iteration <= iterations; ++iteration ) {
+        // The slices before 'iteration - 1' start from the same state as in the last iteration
+        // so their fine results are already known.
+        if( my_rank >= iteration - 1 ) {
+            if( fine( &states[my_rank * OBJECT_COUNT],
+                      &fine_ends[my_rank * OBJECT_COUNT], slice ) != 0 ) status = -1;
+        }
+        MPI_Allreduce( MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD );
+        if( status != 0 ) break;
+        MPI_Allgather( MPI_IN_PLACE, 0, MPI_DATATYPE_NULL,
+                       fine_ends, OBJECT_COUNT, dynamics_type, MPI_COMM_WORLD );
+
+        // The correction is carried forward from slice to slice. Every node does the same
+        // computation so the estimates stay in agreement without being exchanged.
+        double change = 0.0;
+        for( int n = iteration - 1; n < number_of_nodes; ++n ) {
+            ObjectDynamics *coarse_end = &coarse_ends[n * OBJECT_COUNT];
+            ObjectDynamics *fine_end   = &fine_ends[n * OBJECT_COUNT];
+            ObjectDynamics *next       = &states[( n + 1 ) * OBJECT_COUNT];
+
+            // The start of the first slice is unchanged so its coarse result is too.
+            memcpy( corrected, coarse_end, STATE_SIZE );
+            if( n > iteration - 1 &&
+                coarse( &states[n * OBJECT_COUNT], coarse_end, slice ) != 0 ) {
+                status = -1;
+                break;
+            }
+
+            // corrected holds the old coarse result. Turn it into the new estimate.
+            for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+                corrected[object_i].position = v3_add( coarse_end[object_i].position,
+                    v3_subtract( fine_end[object_i].position, corrected[object_i].position ) );
+                corrected[object_i].velocity = v3_add( coarse_end[object_i].velocity,
+                    v3_subtract( fine_end[object_i].velocity, corrected[object_i].velocity ) );
+            }
+            double slice_change = largest_change( corrected, next );
+            if( slice_change > change ) change = slice_change;
+            memcpy( next, corrected, STATE_SIZE );
+        }
+
+        if( my_rank == 0 ) {
+            fprintf( stderr, "Parareal iteration %d: largest change = %.3E AU\n",
+                     iteration, change );
+        }
+        if( change <= options.parareal_tolerance ) break;
+    }
+
+    if( status == 0 ) {
+        memcpy( current_dynamics, &states[number_of_nodes * OBJECT_COUNT], STATE_SIZE );
+    }
+
+    MPI_Type_free( &dynamics_type );
+    free( states );
+    free( coarse_ends );
+    free( fine_ends );
+    free( corrected );
+    return status;
+}
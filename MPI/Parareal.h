@@ -0,0 +1,57 @@
+/*! \file    Parareal.h
+ *  \brief   Interface to the time parallel Parareal integration.
+ *  \author  Peter Chapin <spicacality@kelseymountain.org>
+ *
+ * Dividing the objects among the nodes stops paying once each node has only a few objects: the
+ * exchange of accelerations after every force evaluation then costs more than the forces. The
+ * Parareal method of Lions, Maday, and Turinici (2001) divides the simulated time instead. Each
+ * node is given one slice of the interval. A cheap coarse propagator (options.parareal_coarse
+ * with steps of options.parareal_coarse_step seconds) is run across all the slices in turn to
+ * estimate the state at the start of each. Every node then runs the expensive fine propagator
+ * (options.integrator with steps of options.time_step seconds) across its own slice, all at
+ * once. The results correct the coarse estimates:
+ *
+ * U[n + 1] = G( U[n] ) + F( old U[n] ) - G( old U[n] )
+ *
+ * where F and G are the fine and coarse propagators over a slice. The correction is repeated
+ * until no position changes by more than options.parareal_tolerance AU or until
+ * options.parareal_iterations iterations have been done. After k iterations the first k slices
+ * are exactly as the fine propagator alone would compute them, so at most one iteration per
+ * node is ever needed. When the method converges in k iterations with P nodes it is about P / k
+ * times faster than the fine propagator alone, less the time spent in the coarse propagator.
+ */
+
+#ifndef PARAREAL_H
+#define PARAREAL_H
+
+#include <mpi.h>
+#include "global.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Advance current_dynamics by 'duration' seconds, dividing the time among the MPI nodes.
+/*!
+ * Every node must call this function. On return every node has the final state in
+ * current_dynamics. The block integrator cannot be used for either propagator because it does
+ * not bring the velocities of all objects to the same time at the end of each step.
+ *
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int Parareal_advance( double duration );
+
+// The following are defined in Object.c.
+
+//! Describe the ObjectDynamics structure to MPI.
+void build_MPI_dynamics_type( MPI_Datatype *type );
+
+//! Compute the accelerations of all objects at the positions in 'dynamics' on this node alone.
+void local_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
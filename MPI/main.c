@@ -8,38 +8,85 @@
 #include <mpi.h>
 
 #include "global.h"
+#include "AllPairs.h"
+#include "DenseOutput.h"
 #include "Initialize.h"
+#include "Options.h"
+#include "Parareal.h"
 #include "Timer.h"
 
-#define STEPS_PER_YEAR 8766  // Number of hours in a year.
+#define SECONDS_PER_YEAR 3.15576E+07  // Seconds in a year of 365.25 days.
 
 int main( int argc, char **argv )
 {
     Timer stopwatch;
+    DenseOutput dense_output;
     long long total_steps = 0;
     int total_years       = 0;
+    double year_time      = 0.0;
     int return_code       = EXIT_SUCCESS;
     int my_rank;
 
     MPI_Init( &argc, &argv );
     MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
 
+    if( Options_parse( argc, argv ) != 0 ) {
+        if( my_rank == 0 ) Options_usage( stderr );
+        MPI_Finalize( );
+        return EXIT_FAILURE;
+    }
+
+    if( options.parareal_iterations > 0 && ( options.integrator == INTEGRATOR_BLOCK ||
+                                             options.parareal_coarse == INTEGRATOR_BLOCK ) ) {
+        if( my_rank == 0 )
+            fprintf( stderr, "The block method cannot be used with Parareal iterations\n" );
+        MPI_Finalize( );
+        return EXIT_FAILURE;
+    }
+
+    if( options.parareal_iterations > 0 && options.epochs[0] != '\0' ) {
+        if( my_rank == 0 )
+            fprintf( stderr, "Output epochs cannot be used with Parareal iterations\n" );
+        MPI_Finalize( );
+        return EXIT_FAILURE;
+    }
+
+    // Only the master prints so only it needs the epochs.
+    if( DenseOutput_initialize( &dense_output, ( my_rank == 0 ) ? options.epochs : "" ) != 0 ) {
+        fprintf( stderr, "Unable to read the output epochs from %s\n", options.epochs );
+        MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+    }
+
     initialize_object_arrays( );
     Timer_initialize( &stopwatch );
     if( my_rank == 0 ) {
+        printf( "Using the %s force kernel\n", AllPairs_isa_name( ) );
         printf( "START position\n" );
         dump_dynamics( );
     }
     Timer_start( &stopwatch );
-    while( 1 ) {
-        time_step( );
+
+    // Parareal divides the year among the nodes instead of dividing the objects.
+    if( options.parareal_iterations > 0 ) {
+        if( Parareal_advance( SECONDS_PER_YEAR ) != 0 ) {
+            if( my_rank == 0 ) fprintf( stderr, "Insufficient memory for Parareal\n" );
+            return_code = EXIT_FAILURE;
+        }
+    }
+    else while( 1 ) {
+        DenseOutput_begin_step( &dense_output );
+        double step = time_step( SECONDS_PER_YEAR - year_time );
+        DenseOutput_end_step( &dense_output, step );
+        year_time += step;
         total_steps++;
 
         // Print out a message after 100 steps just to give the user something to see.
         if( total_steps % 100 == 0 && my_rank == 0)
             fprintf( stderr, "STEP %4lld\n", total_steps );
 
-        if( total_steps % STEPS_PER_YEAR == 0 ) {
+        // Block steps do not stop at the end of the year. Any excess counts toward the next.
+        if( year_time >= SECONDS_PER_YEAR ) {
+            year_time -= SECONDS_PER_YEAR;
             total_years++;
             if( total_years % 10 == 0 && my_rank == 0) {
                 fprintf( stderr, "Years simulated = %d\r", total_years );
@@ -56,6 +103,7 @@ int main( int argc, char **argv )
         dump_dynamics( );
         printf( "Time elapsed = %ld milliseconds\n", Timer_time( &stopwatch ) );
     }
+    DenseOutput_destroy( &dense_output );
 
     MPI_Finalize( );
     return return_code;
@@ -6,48 +6,148 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <omp.h>
 
 #include "global.h"
+#include "AllPairs.h"
+#include "BodyStore.h"
+#include "Integrator.h"
+#include "Options.h"
 
-void time_step( )
+// Report that AllPairs_prepare could not allocate the force accumulators and stop.
+static void stop_unprepared( )
 {
-    int object_i;
-
-    // For each object...
-    #pragma omp parallel for
-    for( object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
-        Vector3 total_force = { 0.0, 0.0, 0.0 };
-
-        // Consider interactions with all other objects...
-        for( int object_j = 0; object_j < OBJECT_COUNT; ++object_j ) {
-            if( object_i == object_j ) continue;
-
-            Vector3 displacement = v3_subtract(
-                current_dynamics[object_j].position, current_dynamics[object_i].position );
-            double distance_squared = magnitude_squared( displacement );
-            double distance = sqrt( distance_squared );
-            double force_magnitude =
-                ( G * object_array[object_i].mass * object_array[object_j].mass ) / distance_squared;
-            Vector3 force = v3_multiply( (force_magnitude / distance ), displacement );
-            total_force = v3_add( total_force, force );
+    fprintf( stderr, "Unable to allocate the force accumulators\n" );
+    exit( EXIT_FAILURE );
+}
+
+
+// Compute the accelerations of all objects at the positions in 'dynamics'.
+static void compute_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
+{
+    int thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+    int prepared     = 0;
+
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    omp_set_schedule( omp_sched_static, options.chunk_size );
+
+    #pragma omp parallel num_threads( thread_count )
+    {
+        #pragma omp single
+        prepared = ( AllPairs_prepare( &body_store, omp_get_num_threads( ) ) == 0 );
+
+        // The single construct ends with a barrier so every thread sees the same 'prepared'.
+        if( prepared ) {
+            AllPairs_compute( &body_store, omp_get_thread_num( ) );
+            #pragma omp barrier
+
+            #pragma omp for schedule( runtime )
+            for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+                AllPairs_finish( &body_store, object_i, object_i + 1 );
+                accelerations[object_i] = BodyStore_acceleration( &body_store, object_i );
+                if( jerks != NULL ) jerks[object_i] = BodyStore_jerk( &body_store, object_i );
+            }
+        }
+    }
+    if( !prepared ) stop_unprepared( );
+}
+
+
+// Compute the accelerations of the active objects at the positions in 'dynamics'.
+static void compute_active_accelerations( const ObjectDynamics *dynamics,
+    const int *active, int active_count, Vector3 *accelerations )
+{
+    int thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    omp_set_schedule( omp_sched_static, options.chunk_size );
+
+    #pragma omp parallel for schedule( runtime ) num_threads( thread_count )
+    for( int i = 0; i < active_count; ++i ) {
+        AllPairs_forces( &body_store, active[i], active[i] + 1 );
+        accelerations[active[i]] = BodyStore_acceleration( &body_store, active[i] );
+    }
+}
+
+
+double time_step( double maximum )
+{
+    double step = ( options.time_step < maximum ) ? options.time_step : maximum;
+
+    // Every block step must have the same base step (see Integrator_block_step) so it is not
+    // shortened to fit 'maximum'.
+    if( options.integrator == INTEGRATOR_BLOCK ) {
+        step = options.time_step;
+        if( Integrator_block_step( compute_active_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
         }
+        return step;
+    }
+    if( options.step_control == STEP_ADAPTIVE ) {
+        step = Integrator_choose_step( compute_accelerations, step );
+        if( step < 0.0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
 
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass);
-        Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
-        Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
+    // Choosing the step computed the forces. The integrator's Euler step uses them.
+    if( options.integrator != INTEGRATOR_EULER || options.step_control == STEP_ADAPTIVE ) {
+        if( Integrator_step( compute_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+
+    // Unless the options say otherwise, the team size is OpenMP's default.
+    int thread_count = ( options.threads > 0 ) ? options.threads : omp_get_max_threads( );
+    int prepared     = 0;
+
+    BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+
+    // A chunk size of zero gives each thread one contiguous share of the objects.
+    omp_set_schedule( omp_sched_static, options.chunk_size );
 
-        next_dynamics[object_i].velocity =
-            v3_add( current_dynamics[object_i].velocity, delta_v );
+    #pragma omp parallel num_threads( thread_count )
+    {
+        // The team might be smaller than requested so its real size is used.
+        #pragma omp single
+        prepared = ( AllPairs_prepare( &body_store, omp_get_num_threads( ) ) == 0 );
 
-        next_dynamics[object_i].position =
-            v3_add( current_dynamics[object_i].position, delta_position );
+        // The single construct ends with a barrier so every thread sees the same 'prepared'.
+        if( prepared ) {
+            // Consider interactions between all pairs of objects.
+            AllPairs_compute( &body_store, omp_get_thread_num( ) );
+            #pragma omp barrier
+
+            // For each object...
+            #pragma omp for schedule( runtime )
+            for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+                AllPairs_finish( &body_store, object_i, object_i + 1 );
+                // The acceleration of object_i is now known. Compute velocity and position.
+                Vector3 acceleration   = BodyStore_acceleration( &body_store, object_i );
+                Vector3 delta_v        = v3_multiply( step, acceleration );
+                Vector3 delta_position =
+                    v3_multiply( step, current_dynamics[object_i].velocity );
+
+                next_dynamics[object_i].velocity =
+                    v3_add( current_dynamics[object_i].velocity, delta_v );
+
+                next_dynamics[object_i].position =
+                    v3_add( current_dynamics[object_i].position, delta_position );
+            }
+        }
     }
+    if( !prepared ) stop_unprepared( );
 
     // Swap the dynamics arrays.
     ObjectDynamics *temp = current_dynamics;
     current_dynamics     = next_dynamics;
     next_dynamics        = temp;
+    return step;
 }
 
 
@@ -9,31 +9,24 @@
 #include <pthread.h>
 
 #include "global.h"
+#include "AllPairs.h"
+#include "BodyStore.h"
+#include "Integrator.h"
+#include "Options.h"
 
-void time_step( int start_index, int end_index )
+void euler_step( int start_index, int end_index )
 {
+    double h = options.time_step;
+
+    // The forces were computed by the main program. Collect the totals for this range.
+    AllPairs_finish( &body_store, start_index, end_index );
+
     // For each object in the specified range...
     for( int object_i = start_index; object_i < end_index; ++object_i ) {
-        Vector3 total_force = { 0.0, 0.0, 0.0 };
-
-        // Consider interactions with all other objects...
-        for( int object_j = 0; object_j < OBJECT_COUNT; ++object_j ) {
-            if( object_i == object_j ) continue;
-
-            Vector3 displacement = v3_subtract(
-                current_dynamics[object_j].position, current_dynamics[object_i].position );
-            double distance_squared = magnitude_squared( displacement );
-            double distance = sqrt( distance_squared );
-            double force_magnitude =
-                ( G * object_array[object_i].mass * object_array[object_j].mass ) / distance_squared;
-            Vector3 force = v3_multiply( (force_magnitude / distance ), displacement );
-            total_force = v3_add( total_force, force );
-        }
-
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass);
-        Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
-        Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
+        // The acceleration of object_i is now known. Compute velocity and position.
+        Vector3 acceleration   = BodyStore_acceleration( &body_store, object_i );
+        Vector3 delta_v        = v3_multiply( h, acceleration );
+        Vector3 delta_position = v3_multiply( h, current_dynamics[object_i].velocity );
 
         next_dynamics[object_i].velocity =
             v3_add( current_dynamics[object_i].velocity, delta_v );
@@ -44,6 +37,101 @@ void time_step( int start_index, int end_index )
 }
 
 
+void finish_forces( int start_index, int end_index )
+{
+    AllPairs_finish( &body_store, start_index, end_index );
+}
+
+
+void leapfrog_drift( int start_index, int end_index )
+{
+    double h = options.time_step;
+
+    for( int object_i = start_index; object_i < end_index; ++object_i ) {
+        Vector3 acceleration = BodyStore_acceleration( &body_store, object_i );
+
+        current_dynamics[object_i].velocity = v3_add(
+            current_dynamics[object_i].velocity, v3_multiply( 0.5 * h, acceleration ) );
+
+        current_dynamics[object_i].position = v3_add(
+            current_dynamics[object_i].position,
+            v3_multiply( h, current_dynamics[object_i].velocity ) );
+    }
+}
+
+
+void leapfrog_kick( int start_index, int end_index )
+{
+    double h = options.time_step;
+
+    AllPairs_finish( &body_store, start_index, end_index );
+
+    for( int object_i = start_index; object_i < end_index; ++object_i ) {
+        Vector3 acceleration = BodyStore_acceleration( &body_store, object_i );
+
+        current_dynamics[object_i].velocity = v3_add(
+            current_dynamics[object_i].velocity, v3_multiply( 0.5 * h, acceleration ) );
+    }
+}
+
+
+// The accelerations and jerks at the start of the current Hermite step. The body store holds
+// those of the predicted state while the step is corrected so they are kept here.
+static Vector3 *start_accelerations;
+static Vector3 *start_jerks;
+
+int hermite_reserve( void )
+{
+    if( start_accelerations != NULL ) return 0;
+
+    start_accelerations = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    start_jerks         = (Vector3 *)malloc( OBJECT_COUNT * sizeof(Vector3) );
+    if( start_accelerations == NULL || start_jerks == NULL ) {
+        free( start_accelerations );
+        free( start_jerks );
+        start_accelerations = start_jerks = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+
+void hermite_start( int start_index, int end_index )
+{
+    AllPairs_finish( &body_store, start_index, end_index );
+
+    for( int object_i = start_index; object_i < end_index; ++object_i ) {
+        start_accelerations[object_i] = BodyStore_acceleration( &body_store, object_i );
+        start_jerks[object_i]         = BodyStore_jerk( &body_store, object_i );
+    }
+}
+
+
+void hermite_predict( int start_index, int end_index )
+{
+    for( int object_i = start_index; object_i < end_index; ++object_i ) {
+        next_dynamics[object_i] = Integrator_hermite_predict( &current_dynamics[object_i],
+            start_accelerations[object_i], start_jerks[object_i], options.time_step );
+    }
+}
+
+
+void hermite_correct( int start_index, int end_index )
+{
+    AllPairs_finish( &body_store, start_index, end_index );
+
+    for( int object_i = start_index; object_i < end_index; ++object_i ) {
+        Vector3 a1 = BodyStore_acceleration( &body_store, object_i );
+        Vector3 j1 = BodyStore_jerk( &body_store, object_i );
+
+        Integrator_hermite_correct( &current_dynamics[object_i],
+            start_accelerations[object_i], start_jerks[object_i], a1, j1, options.time_step );
+        start_accelerations[object_i] = a1;
+        start_jerks[object_i]         = j1;
+    }
+}
+
+
 void dump_dynamics( )
 {
     for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
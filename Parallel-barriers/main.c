@@ -3,46 +3,129 @@
  *  \author  Peter Chapin <spicacality@kelseymountain.org>
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
-#if defined(__GLIBC__) || defined(__CYGWIN__)
-#include <sys/sysinfo.h>
-#endif
 #include "global.h"
+#include "AllPairs.h"
+#include "Autotune.h"
+#include "BodyStore.h"
 #include "Initialize.h"
+#include "Options.h"
 #include "Timer.h"
 
-#define STEPS_PER_YEAR 8766  // Number of hours in a year.
+#define SECONDS_PER_YEAR 3.15576E+07  // Seconds in a year of 365.25 days.
 
-//! Compute the next dynamics from the current dynamics.
+//! Compute the next dynamics from the current dynamics with Euler's method.
 /*!
- * This function takes one step of simulated time.
+ * This function takes one step of options.time_step seconds.
  *
  * \param start_index The object ID of the first object managed by this thread.
  * \param end_index The object ID just past the last object managed by this thread.
  */
-void time_step( int start_index, int end_index );
+void euler_step( int start_index, int end_index );
+
+//! Take the first half of a leapfrog step: a half step kick and a full step drift.
+/*!
+ * The accelerations of the objects in the range must be in the body store.
+ */
+void leapfrog_drift( int start_index, int end_index );
+
+//! Take the second half of a leapfrog step: a half step kick with the new accelerations.
+/*!
+ * The accelerations of the objects in the range are completed (see AllPairs_finish) first.
+ */
+void leapfrog_kick( int start_index, int end_index );
+
+//! Complete the accelerations of the objects in the range (see AllPairs_finish).
+void finish_forces( int start_index, int end_index );
+
+//! Allocate the arrays that hold the accelerations and jerks between Hermite steps.
+/*!
+ * \return Zero if successful or -1 if memory could not be allocated.
+ */
+int hermite_reserve( void );
+
+//! Complete the accelerations and jerks of the objects in the range and keep them.
+void hermite_start( int start_index, int end_index );
+
+//! Predict the dynamics of the objects in the range at the end of the step into next_dynamics.
+void hermite_predict( int start_index, int end_index );
+
+//! Correct the dynamics of the objects in the range with the forces at the predicted state.
+/*!
+ * The accelerations and jerks in the body store (of the predicted state) are completed first.
+ * They are kept for the next step.
+ */
+void hermite_correct( int start_index, int end_index );
 
 struct TaskDescriptor {
+    int thread_id;    // Zero based index of the thread.
+    int thread_count; // Number of threads working together.
     int start_index;  // Object ID at the start of thread's work space.
     int end_index;    // Object ID at the end of thread's work space.
     int step_count;   // Number of steps the thread should take.
 };
 
+pthread_barrier_t force_barrier; // Used to synchronize threads between force phases.
 pthread_barrier_t step_barrier;  // Used to synchronize threads while stepping.
 pthread_barrier_t swap_barrier;  // Used to synchronize threads after dynamics swapping.
 long long total_steps = 0;  // Total number of steps executed so far.
 int       total_years = 0;  // Total number of years simulated so far.
+int       steps_per_year;   // Number of steps of options.time_step seconds in a year.
+
+// The options that affect the speed of this program.
+static const char *const tuned_options[] =
+    { "force", "tile-rows", "tile-columns", "threads", "chunk-size", NULL };
+
+
+// Apply 'action' to the objects belonging to a thread. With a chunk size the threads take
+// turns with chunks of that size. Otherwise each thread takes its own contiguous share.
+static void for_each_range( struct TaskDescriptor *task, void (*action)( int, int ) )
+{
+    if( options.chunk_size == 0 ) {
+        action( task->start_index, task->end_index );
+    }
+    else {
+        int stride = options.chunk_size * task->thread_count;
+        for( int start = task->thread_id * options.chunk_size;
+             start < OBJECT_COUNT; start += stride ) {
+            int end = start + options.chunk_size;
+            action( start, ( end < OBJECT_COUNT ) ? end : OBJECT_COUNT );
+        }
+    }
+}
 
 
 void *thread_function( void *arg )
 {
     ObjectDynamics *temp;
     struct TaskDescriptor *task = (struct TaskDescriptor *)arg;
+    int leapfrog = ( options.integrator == INTEGRATOR_LEAPFROG );
+    int hermite  = ( options.integrator == INTEGRATOR_HERMITE );
+
+    // The leapfrog and Hermite methods update the dynamics in place. Their first steps need the
+    // forces at the initial positions. After that each step ends with the forces the next one
+    // starts with.
+    if( leapfrog || hermite ) {
+        AllPairs_compute( &body_store, task->thread_id );
+        pthread_barrier_wait( &force_barrier );
+        for_each_range( task, hermite ? hermite_start : finish_forces );
+    }
 
     for( int i = 0; i < task->step_count; ++i ) {
-        time_step( task->start_index, task->end_index );
+        if( leapfrog ) {
+            for_each_range( task, leapfrog_drift );
+        }
+        else if( hermite ) {
+            for_each_range( task, hermite_predict );
+        }
+        else {
+            AllPairs_compute( &body_store, task->thread_id );
+            pthread_barrier_wait( &force_barrier );
+            for_each_range( task, euler_step );
+        }
         if( pthread_barrier_wait( &step_barrier ) == PTHREAD_BARRIER_SERIAL_THREAD ) {
             total_steps++;
 
@@ -50,7 +133,7 @@ void *thread_function( void *arg )
             if( total_steps % 100 == 0 )
                 fprintf( stderr, "STEP %4lld\n", total_steps );
 
-            if( total_steps % STEPS_PER_YEAR == 0 ) {
+            if( total_steps % steps_per_year == 0 ) {
                 total_years++;
                 if( total_years % 10 == 0 ) {
                     fprintf( stderr, "Years simulated = %d\r", total_years );
@@ -58,39 +141,50 @@ void *thread_function( void *arg )
                 }
             }
             // Swap the dynamics arrays.
-            temp             = current_dynamics;
-            current_dynamics = next_dynamics;
-            next_dynamics    = temp;
+            if( !leapfrog && !hermite ) {
+                temp             = current_dynamics;
+                current_dynamics = next_dynamics;
+                next_dynamics    = temp;
+            }
+
+            // Refresh the force kernels' copy of the dynamics before the next step starts. The
+            // Hermite method evaluates the forces at its prediction.
+            BodyStore_load(
+                &body_store, hermite ? next_dynamics : current_dynamics, 0, OBJECT_COUNT );
         }
         pthread_barrier_wait( &swap_barrier );
+        if( leapfrog || hermite ) {
+            AllPairs_compute( &body_store, task->thread_id );
+            pthread_barrier_wait( &force_barrier );
+            for_each_range( task, hermite ? hermite_correct : leapfrog_kick );
+        }
     }
     free( task );
     return NULL;
 }
 
 
-int main( int argc, char **argv )
+//! Advance the simulation by 'step_count' steps using one thread per processor.
+/*!
+ * The threads are created at the start and run for all the steps, synchronizing with barriers
+ * between the phases of each step. This is also used by the tuner.
+ */
+void run_steps( int step_count )
 {
-    Timer stopwatch;
-    int   return_code = EXIT_SUCCESS;
-
-    #if defined(__GLIBC__) || defined(__CYGWIN__)
-    int processor_count = get_nprocs( );
-    #else
-    int processor_count = pthread_num_processors_np( );
-    #endif
-
+    int processor_count = Options_thread_count( );
     int objects_per_processor = OBJECT_COUNT / processor_count;
     pthread_t *thread_IDs;
 
-    printf( "%d processing elements detected!\n", processor_count );
-
-    initialize_object_arrays( );
-    Timer_initialize( &stopwatch );
-    printf( "START position\n" );
-    dump_dynamics( );
-    Timer_start( &stopwatch );
-
+    BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+    if( options.integrator == INTEGRATOR_HERMITE && hermite_reserve( ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the Hermite integrator's arrays\n" );
+        exit( EXIT_FAILURE );
+    }
+    if( AllPairs_prepare( &body_store, processor_count ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the force accumulators\n" );
+        exit( EXIT_FAILURE );
+    }
+    pthread_barrier_init( &force_barrier, NULL, processor_count );
     pthread_barrier_init( &step_barrier, NULL, processor_count );
     pthread_barrier_init( &swap_barrier, NULL, processor_count );
     thread_IDs = (pthread_t *)malloc( processor_count * sizeof(pthread_t) );
@@ -99,8 +193,10 @@ int main( int argc, char **argv )
     for( int i = 0; i < processor_count; ++i ) {
         struct TaskDescriptor *task =
             (struct TaskDescriptor *)malloc( sizeof( struct TaskDescriptor ) );
-        task->step_count = STEPS_PER_YEAR * 1;
-        task->start_index = i * objects_per_processor;
+        task->thread_id    = i;
+        task->thread_count = processor_count;
+        task->step_count   = step_count;
+        task->start_index  = i * objects_per_processor;
         if( i == processor_count - 1 )
             task->end_index = OBJECT_COUNT;
         else
@@ -114,9 +210,81 @@ int main( int argc, char **argv )
     }
 
     free( thread_IDs );
+    pthread_barrier_destroy( &force_barrier );
     pthread_barrier_destroy( &step_barrier );
     pthread_barrier_destroy( &swap_barrier );
+}
+
+
+int main( int argc, char **argv )
+{
+    Timer stopwatch;
+    int   return_code = EXIT_SUCCESS;
+
+    if( Options_parse( argc, argv ) != 0 ) {
+        Options_usage( stderr );
+        return EXIT_FAILURE;
+    }
 
+    // The threads run whole steps in lock-step. Individual steps would leave most of them idle.
+    if( options.integrator == INTEGRATOR_BLOCK ) {
+        fprintf( stderr, "Block time steps are not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+    if( options.integrator == INTEGRATOR_WISDOM_HOLMAN ) {
+        fprintf( stderr, "The Wisdom-Holman method is not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+    if( options.integrator == INTEGRATOR_IAS15 ) {
+        fprintf( stderr, "The IAS15 method is not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+    if( options.integrator == INTEGRATOR_RESPA ) {
+        fprintf( stderr, "The RESPA method is not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+    if( options.integrator == INTEGRATOR_ENCOUNTER ) {
+        fprintf( stderr, "The encounter method is not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+    if( options.integrator == INTEGRATOR_YOSHIDA4 ||
+        options.integrator == INTEGRATOR_YOSHIDA6 ) {
+        fprintf( stderr, "The Yoshida methods are not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+    if( options.step_control == STEP_ADAPTIVE ) {
+        fprintf( stderr, "Adaptive steps are not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+    if( options.epochs[0] != '\0' ) {
+        fprintf( stderr, "Output epochs are not supported by this program\n" );
+        return EXIT_FAILURE;
+    }
+
+    // Each thread counts its own steps so the step is fixed. It is shortened if necessary to
+    // fit a whole number of steps in a year.
+    steps_per_year    = (int)ceil( SECONDS_PER_YEAR / options.time_step );
+    options.time_step = SECONDS_PER_YEAR / steps_per_year;
+
+    initialize_object_arrays( );
+    if( options.autotune ) {
+        if( Autotune_run( tuned_options, run_steps, NULL ) != 0 ) return EXIT_FAILURE;
+        total_steps = 0;
+        total_years = 0;
+    }
+    printf( "%d processing elements detected!\n", Options_thread_count( ) );
+
+    BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+    Timer_initialize( &stopwatch );
+    printf( "Using the %s force kernel\n", AllPairs_isa_name( ) );
+    if( options.precision == PRECISION_MIXED ) {
+        printf( "Relative force error of mixed precision = %.3E\n",
+                AllPairs_mixed_precision_error( &body_store ) );
+    }
+    printf( "START position\n" );
+    dump_dynamics( );
+    Timer_start( &stopwatch );
+    run_steps( steps_per_year * 1 );
     Timer_stop( &stopwatch );
     printf( "\nEND position\n" );
     dump_dynamics( );
@@ -6,12 +6,13 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
-#if defined(__GLIBC__) || defined(__CYGWIN__)
-#include <sys/sysinfo.h>
-#endif
 
 #include "global.h"
+#include "AllPairs.h"
+#include "BodyStore.h"
 #include "Initialize.h"
+#include "Integrator.h"
+#include "Options.h"
 #include "ThreadPool.h"
 
 extern Object         *object_array;
@@ -21,36 +22,50 @@ extern ObjectDynamics *next_dynamics;
 extern ThreadPool pool;
 
 struct Work_Unit {
+    int thread_id;
     int start_index;
     int stop_index;
 };
 
+void *compute_forces(void *arg)
+{
+    struct Work_Unit *chunk = (struct Work_Unit *)arg;
+
+    // Consider interactions between all pairs of objects.
+    AllPairs_compute( &body_store, chunk->thread_id );
+    return NULL;
+}
+
+
+// Where the work units put the accelerations and jerks for compute_accelerations. When
+// acceleration_output is NULL the work units advance the objects with Euler's method instead.
+// The jerks are only wanted by the Hermite method.
+static Vector3 *acceleration_output;
+static Vector3 *jerk_output;
+
+// The length of the Euler step the threads take.
+static double euler_step;
+
 void *compute_next_dynamics(void *arg)
 {
     struct Work_Unit *chunk = (struct Work_Unit *)arg;
     
-    // For each object...
-    for( int object_i = chunk->start_index; object_i < chunk->stop_index; ++object_i ) {
-        Vector3 total_force = { 0.0, 0.0, 0.0 };
-
-        // Consider interactions with all other objects...
-        for( int object_j = 0; object_j < OBJECT_COUNT; ++object_j ) {
-            if( object_i == object_j ) continue;
-
-            Vector3 displacement = v3_subtract(
-                current_dynamics[object_j].position, current_dynamics[object_i].position );
-            double distance_squared = magnitude_squared( displacement );
-            double distance = sqrt( distance_squared );
-            double force_magnitude =
-                ( G * object_array[object_i].mass * object_array[object_j].mass ) / distance_squared;
-            Vector3 force = v3_multiply( (force_magnitude / distance ), displacement );
-            total_force = v3_add( total_force, force );
+    AllPairs_finish( &body_store, chunk->start_index, chunk->stop_index );
+    if( acceleration_output != NULL ) {
+        for( int object_i = chunk->start_index; object_i < chunk->stop_index; ++object_i ) {
+            acceleration_output[object_i] = BodyStore_acceleration( &body_store, object_i );
+            if( jerk_output != NULL )
+                jerk_output[object_i] = BodyStore_jerk( &body_store, object_i );
         }
+        return NULL;
+    }
 
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass );
-        Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
-        Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
+    // For each object...
+    for( int object_i = chunk->start_index; object_i < chunk->stop_index; ++object_i ) {
+        // The acceleration of object_i is now known. Compute velocity and position.
+        Vector3 acceleration   = BodyStore_acceleration( &body_store, object_i );
+        Vector3 delta_v        = v3_multiply( euler_step, acceleration );
+        Vector3 delta_position = v3_multiply( euler_step, current_dynamics[object_i].velocity );
 
         next_dynamics[object_i].velocity =
             v3_add( current_dynamics[object_i].velocity, delta_v );
@@ -62,45 +77,170 @@ void *compute_next_dynamics(void *arg)
 }
 
 
-void time_step( )
+// Run a work function on each of 'count' work units and wait for all of them to finish.
+static void run_work_units(
+    void *( *work_function )( void * ), struct Work_Unit *units, int count )
 {
-    #if defined(__GLIBC__) || defined(__CYGWIN__)
-    int processor_count = get_nprocs( );
-    #else
-    int processor_count = pthread_num_processors_np( );
-    #endif
-    int objects_per_processor = OBJECT_COUNT / processor_count;
+    int         pool_size  = ThreadPool_count( &pool );
+    threadid_t *thread_IDs = (threadid_t *)malloc( count * sizeof(threadid_t) );
+
+    // There can be more work units than threads. Once every thread has been given a unit, the
+    // oldest result is collected before each new start so a thread is always free for it.
+    for( int i = 0; i < count; ++i ) {
+        if( i >= pool_size )
+            ThreadPool_result( &pool, thread_IDs[i - pool_size] );
+        thread_IDs[i] = ThreadPool_start( &pool, work_function, &units[i] );
+    }
+    for( int i = ( count > pool_size ) ? count - pool_size : 0; i < count; ++i ) {
+        ThreadPool_result( &pool, thread_IDs[i] );
+    }
+    free( thread_IDs );
+}
 
-    struct Work_Unit *chunks =
+
+// Compute the accelerations (into acceleration_output) or the next dynamics of all objects
+// using the pool and the positions in the store.
+static void run_work( )
+{
+    int processor_count = Options_thread_count( );
+    int chunk_size      = OBJECT_COUNT / processor_count;
+    int chunk_count     = processor_count;
+
+    // Without a chunk size each thread gets one share of the objects.
+    if( options.chunk_size > 0 ) {
+        chunk_size  = options.chunk_size;
+        chunk_count = ( OBJECT_COUNT + chunk_size - 1 ) / chunk_size;
+    }
+
+    struct Work_Unit *threads =
         (struct Work_Unit *)malloc( processor_count * sizeof(struct Work_Unit) );
-    threadid_t *thread_IDs =
-        (threadid_t *)malloc( processor_count * sizeof(threadid_t) );
-    
-    // Create a thread for each CPU and set it working on its work unit.
-    for( int i = 0; i < processor_count; ++i ) {
-        struct Work_Unit *chunk =
-            (struct Work_Unit *)malloc( sizeof( struct Work_Unit ) );
-        chunk->start_index = i * objects_per_processor;
-        if( i == processor_count - 1 )
-            chunk->stop_index = OBJECT_COUNT;
-        else
-            chunk->stop_index   = ( i + 1 ) * objects_per_processor;
-        thread_IDs[i] = ThreadPool_start( &pool, compute_next_dynamics, chunk);
+    struct Work_Unit *chunks =
+        (struct Work_Unit *)malloc( chunk_count * sizeof(struct Work_Unit) );
+
+    if( AllPairs_prepare( &body_store, processor_count ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the force accumulators\n" );
+        exit( EXIT_FAILURE );
     }
-    
 
-    // Wait for all threads to end.
+    // Split the problem into chunks. The last chunk takes any left over objects.
     for( int i = 0; i < processor_count; ++i ) {
-        ThreadPool_result( &pool, thread_IDs[i] );
+        threads[i].thread_id = i;
     }
-        
+    for( int i = 0; i < chunk_count; ++i ) {
+        chunks[i].thread_id   = i;
+        chunks[i].start_index = i * chunk_size;
+        chunks[i].stop_index  = ( i + 1 ) * chunk_size;
+    }
+    chunks[chunk_count - 1].stop_index = OBJECT_COUNT;
+
+    // The pool might not be able to run all the work units at once so the threads can't wait
+    // for each other with a barrier. Instead the two phases of the force computation are
+    // dispatched separately, and all the results of the first are collected before the second.
+    run_work_units( compute_forces, threads, processor_count );
+    run_work_units( compute_next_dynamics, chunks, chunk_count );
+
+    free(threads);
+    free(chunks);
+}
+
+
+// Compute the accelerations of all objects at the positions in 'dynamics'.
+static void compute_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
+{
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    acceleration_output = accelerations;
+    jerk_output         = jerks;
+    run_work( );
+    acceleration_output = NULL;
+    jerk_output         = NULL;
+}
+
+
+// The objects whose accelerations compute_active_forces computes. The work units give ranges
+// of indices into this list.
+static const int *active_list;
+
+void *compute_active_forces(void *arg)
+{
+    struct Work_Unit *chunk = (struct Work_Unit *)arg;
+
+    for( int i = chunk->start_index; i < chunk->stop_index; ++i ) {
+        AllPairs_forces( &body_store, active_list[i], active_list[i] + 1 );
+        acceleration_output[active_list[i]] =
+            BodyStore_acceleration( &body_store, active_list[i] );
+    }
+    return NULL;
+}
+
+
+// Compute the accelerations of the active objects at the positions in 'dynamics'.
+static void compute_active_accelerations( const ObjectDynamics *dynamics,
+    const int *active, int active_count, Vector3 *accelerations )
+{
+    int unit_count = Options_thread_count( );
+
+    if( unit_count > active_count ) unit_count = active_count;
+    struct Work_Unit *units =
+        (struct Work_Unit *)malloc( unit_count * sizeof(struct Work_Unit) );
+
+    for( int i = 0; i < unit_count; ++i ) {
+        units[i].thread_id   = i;
+        units[i].start_index = (int)( (long long)active_count *   i       / unit_count );
+        units[i].stop_index  = (int)( (long long)active_count * ( i + 1 ) / unit_count );
+    }
+
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    active_list         = active;
+    acceleration_output = accelerations;
+    run_work_units( compute_active_forces, units, unit_count );
+    acceleration_output = NULL;
+    active_list         = NULL;
+    free( units );
+}
+
+
+double time_step( double maximum )
+{
+    double step = ( options.time_step < maximum ) ? options.time_step : maximum;
+
+    // Every block step must have the same base step (see Integrator_block_step) so it is not
+    // shortened to fit 'maximum'.
+    if( options.integrator == INTEGRATOR_BLOCK ) {
+        step = options.time_step;
+        if( Integrator_block_step( compute_active_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+    if( options.step_control == STEP_ADAPTIVE ) {
+        step = Integrator_choose_step( compute_accelerations, step );
+        if( step < 0.0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    // Choosing the step computed the forces. The integrator's Euler step uses them.
+    if( options.integrator != INTEGRATOR_EULER || options.step_control == STEP_ADAPTIVE ) {
+        if( Integrator_step( compute_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+
+    // The threads only read the positions in the store so they can be loaded before they start.
+    BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+    euler_step = step;
+    run_work( );
+
     // Swap the dynamics arrays.
     ObjectDynamics *temp = current_dynamics;
     current_dynamics     = next_dynamics;
     next_dynamics        = temp;
-
-    free(chunks);
-    free(thread_IDs);
+    return step;
 }
 
 
@@ -7,44 +7,52 @@
 #include <math.h>
 #include <pthread.h>
 #include <stdlib.h>
-#if  defined(__GLIBC__) || defined(__CYGWIN__)
-#include <sys/sysinfo.h>
-#endif
 
 #include "global.h"
+#include "AllPairs.h"
+#include "BodyStore.h"
 #include "Initialize.h"
+#include "Integrator.h"
+#include "Options.h"
 
 struct WorkUnit {
+    int thread_id;
+    int thread_count;
     int start_index;
     int stop_index;
 };
 
-void *compute_next_dynamics(void *arg)
-{
-    struct WorkUnit *chunk = (struct WorkUnit *)arg;
+// Used to wait until all threads have done their share of the force computation.
+static pthread_barrier_t force_barrier;
 
-    // For each object...
-    for( int object_i = chunk->start_index; object_i < chunk->stop_index; ++object_i ) {
-        Vector3 total_force = { 0.0, 0.0, 0.0 };
-
-        // Consider interactions with all other objects...
-        for( int object_j = 0; object_j < OBJECT_COUNT; ++object_j ) {
-            if( object_i == object_j ) continue;
-
-            Vector3 displacement = v3_subtract(
-                current_dynamics[object_j].position, current_dynamics[object_i].position );
-            double distance_squared = magnitude_squared( displacement );
-            double distance = sqrt( distance_squared );
-            double force_magnitude =
-                ( G * object_array[object_i].mass * object_array[object_j].mass ) / distance_squared;
-            Vector3 force = v3_multiply( (force_magnitude / distance ), displacement );
-            total_force = v3_add( total_force, force );
+// Where the threads put the accelerations and jerks for compute_accelerations. When
+// acceleration_output is NULL the threads advance the objects with Euler's method instead. The
+// jerks are only wanted by the Hermite method.
+static Vector3 *acceleration_output;
+static Vector3 *jerk_output;
+
+// The length of the Euler step the threads take.
+static double euler_step;
+
+// Advance the objects in the range [start_index, stop_index) using the computed forces.
+static void advance_range( int start_index, int stop_index )
+{
+    AllPairs_finish( &body_store, start_index, stop_index );
+    if( acceleration_output != NULL ) {
+        for( int object_i = start_index; object_i < stop_index; ++object_i ) {
+            acceleration_output[object_i] = BodyStore_acceleration( &body_store, object_i );
+            if( jerk_output != NULL )
+                jerk_output[object_i] = BodyStore_jerk( &body_store, object_i );
         }
+        return;
+    }
 
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass );
-        Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
-        Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
+    // For each object...
+    for( int object_i = start_index; object_i < stop_index; ++object_i ) {
+        // The acceleration of object_i is now known. Compute velocity and position.
+        Vector3 acceleration   = BodyStore_acceleration( &body_store, object_i );
+        Vector3 delta_v        = v3_multiply( euler_step, acceleration );
+        Vector3 delta_position = v3_multiply( euler_step, current_dynamics[object_i].velocity );
 
         next_dynamics[object_i].velocity =
             v3_add( current_dynamics[object_i].velocity, delta_v );
@@ -52,19 +60,38 @@ void *compute_next_dynamics(void *arg)
         next_dynamics[object_i].position =
             v3_add( current_dynamics[object_i].position, delta_position );
     }
+}
+
+
+void *compute_next_dynamics(void *arg)
+{
+    struct WorkUnit *chunk = (struct WorkUnit *)arg;
+
+    // Consider interactions between all pairs of objects.
+    AllPairs_compute( &body_store, chunk->thread_id );
+    pthread_barrier_wait( &force_barrier );
+
+    // With a chunk size the threads take turns with chunks of that size. Otherwise each thread
+    // takes its own contiguous share.
+    if( options.chunk_size == 0 ) {
+        advance_range( chunk->start_index, chunk->stop_index );
+    }
+    else {
+        int stride = options.chunk_size * chunk->thread_count;
+        for( int start = chunk->thread_id * options.chunk_size;
+             start < OBJECT_COUNT; start += stride ) {
+            int stop = start + options.chunk_size;
+            advance_range( start, ( stop < OBJECT_COUNT ) ? stop : OBJECT_COUNT );
+        }
+    }
     return NULL;
 }
 
 
-void time_step( )
+// Run compute_next_dynamics on one thread per processor using the positions in the store.
+static void run_threads( )
 {
-    #if defined(__GLIBC__) || defined(__CYGWIN__)
-    int processor_count = get_nprocs( );
-    #elif defined(__APPLE__)
-    int processor_count = get_macOS_nprocs( );
-    #else
-    int processor_count = pthread_num_processors_np( );
-    #endif
+    int processor_count = Options_thread_count( );
     int objects_per_processor = OBJECT_COUNT / processor_count;
 
     struct WorkUnit *chunks =
@@ -72,10 +99,18 @@ void time_step( )
     pthread_t *thread_IDs =
         (pthread_t *)malloc( processor_count * sizeof(pthread_t) );
 
+    if( AllPairs_prepare( &body_store, processor_count ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the force accumulators\n" );
+        exit( EXIT_FAILURE );
+    }
+    pthread_barrier_init( &force_barrier, NULL, processor_count );
+
     // Split the problem into chunks.
     for( int i = 0; i < processor_count; ++i ) {
-        chunks[i].start_index = i * objects_per_processor;
-        chunks[i].stop_index = ( i + 1 ) * objects_per_processor;
+        chunks[i].thread_id    = i;
+        chunks[i].thread_count = processor_count;
+        chunks[i].start_index  = i * objects_per_processor;
+        chunks[i].stop_index   = ( i + 1 ) * objects_per_processor;
     }
     chunks[processor_count - 1].stop_index = OBJECT_COUNT;
 
@@ -90,13 +125,116 @@ void time_step( )
         pthread_join( thread_IDs[i], NULL );
     }
 
+    pthread_barrier_destroy( &force_barrier );
+    free(chunks);
+    free(thread_IDs);
+}
+
+
+// Compute the accelerations of all objects at the positions in 'dynamics'.
+static void compute_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
+{
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    acceleration_output = accelerations;
+    jerk_output         = jerks;
+    run_threads( );
+    acceleration_output = NULL;
+    jerk_output         = NULL;
+}
+
+
+// The objects whose accelerations compute_active_forces computes. The work units give ranges
+// of indices into this list.
+static const int *active_list;
+
+void *compute_active_forces(void *arg)
+{
+    struct WorkUnit *chunk = (struct WorkUnit *)arg;
+
+    for( int i = chunk->start_index; i < chunk->stop_index; ++i ) {
+        AllPairs_forces( &body_store, active_list[i], active_list[i] + 1 );
+        acceleration_output[active_list[i]] =
+            BodyStore_acceleration( &body_store, active_list[i] );
+    }
+    return NULL;
+}
+
+
+// Compute the accelerations of the active objects at the positions in 'dynamics'. Each thread
+// takes an even share of them.
+static void compute_active_accelerations( const ObjectDynamics *dynamics,
+    const int *active, int active_count, Vector3 *accelerations )
+{
+    int thread_count = Options_thread_count( );
+
+    if( thread_count > active_count ) thread_count = active_count;
+    struct WorkUnit *chunks =
+        (struct WorkUnit *)malloc( thread_count * sizeof(struct WorkUnit) );
+    pthread_t *thread_IDs =
+        (pthread_t *)malloc( thread_count * sizeof(pthread_t) );
+
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    active_list         = active;
+    acceleration_output = accelerations;
+    for( int i = 0; i < thread_count; ++i ) {
+        chunks[i].thread_id    = i;
+        chunks[i].thread_count = thread_count;
+        chunks[i].start_index  = (int)( (long long)active_count *   i       / thread_count );
+        chunks[i].stop_index   = (int)( (long long)active_count * ( i + 1 ) / thread_count );
+        pthread_create( &thread_IDs[i], NULL, compute_active_forces, &chunks[i] );
+    }
+    for( int i = 0; i < thread_count; ++i ) {
+        pthread_join( thread_IDs[i], NULL );
+    }
+    acceleration_output = NULL;
+    active_list         = NULL;
+    free( chunks );
+    free( thread_IDs );
+}
+
+
+double time_step( double maximum )
+{
+    double step = ( options.time_step < maximum ) ? options.time_step : maximum;
+
+    // Every block step must have the same base step (see Integrator_block_step) so it is not
+    // shortened to fit 'maximum'.
+    if( options.integrator == INTEGRATOR_BLOCK ) {
+        step = options.time_step;
+        if( Integrator_block_step( compute_active_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+    if( options.step_control == STEP_ADAPTIVE ) {
+        step = Integrator_choose_step( compute_accelerations, step );
+        if( step < 0.0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    // Choosing the step computed the forces. The integrator's Euler step uses them.
+    if( options.integrator != INTEGRATOR_EULER || options.step_control == STEP_ADAPTIVE ) {
+        if( Integrator_step( compute_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+
+    // The threads only read the positions in the store so they can be loaded before they start.
+    BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+    euler_step = step;
+    run_threads( );
+
     // Swap the dynamics arrays.
     ObjectDynamics *temp = current_dynamics;
     current_dynamics     = next_dynamics;
     next_dynamics        = temp;
-
-    free(chunks);
-    free(thread_IDs);
+    return step;
 }
 
 
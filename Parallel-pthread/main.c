@@ -7,32 +7,73 @@
 #include <stdlib.h>
 
 #include "global.h"
+#include "AllPairs.h"
+#include "Autotune.h"
+#include "BodyStore.h"
+#include "DenseOutput.h"
 #include "Initialize.h"
+#include "Options.h"
 #include "Timer.h"
 
-#define STEPS_PER_YEAR 8766  // Number of hours in a year.
+#define SECONDS_PER_YEAR 3.15576E+07  // Seconds in a year of 365.25 days.
+
+// The options that affect the speed of this program.
+static const char *const tuned_options[] =
+    { "force", "tile-rows", "tile-columns", "threads", "chunk-size", NULL };
+
+// Advance the simulation by the given number of steps. This is used by the tuner.
+static void advance( int step_count )
+{
+    for( int i = 0; i < step_count; ++i ) time_step( options.time_step );
+}
 
 int main( int argc, char **argv )
 {
     Timer stopwatch;
+    DenseOutput dense_output;
     long long total_steps = 0;
     int total_years       = 0;
+    double year_time      = 0.0;
     int return_code       = EXIT_SUCCESS;
 
+    if( Options_parse( argc, argv ) != 0 ) {
+        Options_usage( stderr );
+        return EXIT_FAILURE;
+    }
+
+    if( DenseOutput_initialize( &dense_output, options.epochs ) != 0 ) {
+        fprintf( stderr, "Unable to read the output epochs from %s\n", options.epochs );
+        return EXIT_FAILURE;
+    }
+
     initialize_object_arrays( );
+    if( options.autotune && Autotune_run( tuned_options, advance, NULL ) != 0 ) {
+        return EXIT_FAILURE;
+    }
     Timer_initialize( &stopwatch );
+    printf( "Using the %s force kernel\n", AllPairs_isa_name( ) );
+    if( options.precision == PRECISION_MIXED ) {
+        BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+        printf( "Relative force error of mixed precision = %.3E\n",
+                AllPairs_mixed_precision_error( &body_store ) );
+    }
     printf( "START position\n" );
     dump_dynamics( );
     Timer_start( &stopwatch );
     while( 1 ) {
-        time_step( );
+        DenseOutput_begin_step( &dense_output );
+        double step = time_step( SECONDS_PER_YEAR - year_time );
+        DenseOutput_end_step( &dense_output, step );
+        year_time += step;
         total_steps++;
 
         // Print out a message after 100 steps just to give the user something to see.
         if( total_steps % 100 == 0 )
             fprintf( stderr, "STEP %4lld\n", total_steps );
 
-        if( total_steps % STEPS_PER_YEAR == 0 ) {
+        // Block steps do not stop at the end of the year. Any excess counts toward the next.
+        if( year_time >= SECONDS_PER_YEAR ) {
+            year_time -= SECONDS_PER_YEAR;
             total_years++;
             if( total_years % 10 == 0 ) {
                 fprintf( stderr, "Years simulated = %d\r", total_years );
@@ -47,6 +88,7 @@ int main( int argc, char **argv )
     printf( "\nEND position\n" );
     dump_dynamics( );
     printf( "Time elapsed = %ld milliseconds\n", Timer_time( &stopwatch ) );
+    DenseOutput_destroy( &dense_output );
 
     return return_code;
 }
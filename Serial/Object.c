@@ -8,35 +8,149 @@
 #include <stdlib.h>
 
 #include "global.h"
+#include "AllPairs.h"
+#include "BodyStore.h"
+#include "Ensemble.h"
+#include "Integrator.h"
+#include "Options.h"
 
-void time_step( )
+// Relative size of the random changes made to the initial positions of the ensemble's copies.
+#define ENSEMBLE_PERTURBATION 1.0E-6
+
+// The copies of the system simulated when options.ensemble_size is nonzero. Simulation zero is
+// the unperturbed system. It is copied back into current_dynamics after every step.
+static Ensemble ensemble;
+
+
+// Return 'value' changed by a random fraction of at most ENSEMBLE_PERTURBATION.
+static double perturb( double value )
 {
-    // For each object...
+    double fraction = 2.0 * ( (double)( rand( ) ) / RAND_MAX ) - 1.0;
+    return value * ( 1.0 + ENSEMBLE_PERTURBATION * fraction );
+}
+
+
+// Load the system into every simulation of the ensemble, perturbing the planets of all but the
+// first. The unused lanes of the last group hold further copies, which are never reported.
+static void initialize_ensemble( )
+{
+    ObjectDynamics *perturbed =
+        (ObjectDynamics *)malloc( OBJECT_COUNT * sizeof(ObjectDynamics) );
+
+    if( perturbed == NULL ||
+        Ensemble_initialize( &ensemble, OBJECT_COUNT, options.ensemble_size ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the ensemble\n" );
+        exit( EXIT_FAILURE );
+    }
+    int lane_count = ensemble.group_count * ENSEMBLE_LANES;
+    for( int simulation = 0; simulation < lane_count; ++simulation ) {
+        for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+            perturbed[object_i] = current_dynamics[object_i];
+            if( simulation > 0 && object_i > 0 ) {
+                perturbed[object_i].position.x = perturb( perturbed[object_i].position.x );
+                perturbed[object_i].position.y = perturb( perturbed[object_i].position.y );
+                perturbed[object_i].position.z = perturb( perturbed[object_i].position.z );
+            }
+        }
+        Ensemble_load( &ensemble, simulation, object_array, perturbed );
+    }
+    free( perturbed );
+}
+
+
+// Advance every simulation of the ensemble by one step of 'step' seconds.
+static void ensemble_time_step( double step )
+{
+    if( ensemble.count == 0 ) initialize_ensemble( );
+
+    AllPairs_ensemble( &ensemble );
+    Ensemble_advance( &ensemble, step );
+    Ensemble_store( &ensemble, 0, current_dynamics );
+}
+
+
+// Compute the accelerations of all objects at the positions in 'dynamics'.
+static void compute_accelerations(
+    const ObjectDynamics *dynamics, Vector3 *accelerations, Vector3 *jerks )
+{
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    if( AllPairs_prepare( &body_store, 1 ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the force accumulators\n" );
+        exit( EXIT_FAILURE );
+    }
+    AllPairs_compute( &body_store, 0 );
+    AllPairs_finish( &body_store, 0, OBJECT_COUNT );
     for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
-        Vector3 total_force = { 0.0, 0.0, 0.0 };
-
-        // Consider interactions with all other objects...
-        for( int object_j = 0; object_j < OBJECT_COUNT; ++object_j ) {
-            if( object_i == object_j ) continue;
-
-            Vector3 displacement = v3_subtract(
-                current_dynamics[object_j].position, current_dynamics[object_i].position );
-            double distance_squared = magnitude_squared( displacement );
-            double distance = sqrt( distance_squared );
-            double force_magnitude =
-                ( G * object_array[object_i].mass * object_array[object_j].mass ) / distance_squared;
-
-            // The displacement (vector) divided by the distance results in a unit vector that
-            // points from object_i to object_j. Multiplying that unit vector by the force
-            // magnitude computes the force vector from object_i to object_j.
-            Vector3 force = v3_multiply( (force_magnitude / distance ), displacement );
-            total_force = v3_add( total_force, force );
+        accelerations[object_i] = BodyStore_acceleration( &body_store, object_i );
+        if( jerks != NULL ) jerks[object_i] = BodyStore_jerk( &body_store, object_i );
+    }
+}
+
+
+// Compute the accelerations of the active objects at the positions in 'dynamics'.
+static void compute_active_accelerations( const ObjectDynamics *dynamics,
+    const int *active, int active_count, Vector3 *accelerations )
+{
+    BodyStore_load( &body_store, dynamics, 0, OBJECT_COUNT );
+    for( int i = 0; i < active_count; ++i ) {
+        AllPairs_forces( &body_store, active[i], active[i] + 1 );
+        accelerations[active[i]] = BodyStore_acceleration( &body_store, active[i] );
+    }
+}
+
+
+double time_step( double maximum )
+{
+    double step = ( options.time_step < maximum ) ? options.time_step : maximum;
+
+    // The ensemble's copies are always advanced with fixed Euler steps.
+    if( options.ensemble_size > 0 ) {
+        ensemble_time_step( step );
+        return step;
+    }
+    // Every block step must have the same base step (see Integrator_block_step) so it is not
+    // shortened to fit 'maximum'.
+    if( options.integrator == INTEGRATOR_BLOCK ) {
+        step = options.time_step;
+        if( Integrator_block_step( compute_active_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+    if( options.step_control == STEP_ADAPTIVE ) {
+        step = Integrator_choose_step( compute_accelerations, step );
+        if( step < 0.0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
         }
+    }
 
-        // Total force on object_i is now known. Compute acceleration, velocity and position.
-        Vector3 acceleration   = v3_divide( total_force, object_array[object_i].mass );
-        Vector3 delta_v        = v3_multiply( TIME_STEP, acceleration );
-        Vector3 delta_position = v3_multiply( TIME_STEP, current_dynamics[object_i].velocity );
+    // Choosing the step computed the forces. The integrator's Euler step uses them.
+    if( options.integrator != INTEGRATOR_EULER || options.step_control == STEP_ADAPTIVE ) {
+        if( Integrator_step( compute_accelerations, step ) != 0 ) {
+            fprintf( stderr, "Unable to allocate the integrator's arrays\n" );
+            exit( EXIT_FAILURE );
+        }
+        return step;
+    }
+
+    // Compute the forces on all objects. There is only one thread so there is nothing to wait
+    // for between the two phases.
+    BodyStore_load( &body_store, current_dynamics, 0, OBJECT_COUNT );
+    if( AllPairs_prepare( &body_store, 1 ) != 0 ) {
+        fprintf( stderr, "Unable to allocate the force accumulators\n" );
+        exit( EXIT_FAILURE );
+    }
+    AllPairs_compute( &body_store, 0 );
+    AllPairs_finish( &body_store, 0, OBJECT_COUNT );
+
+    // For each object...
+    for( int object_i = 0; object_i < OBJECT_COUNT; ++object_i ) {
+        // The acceleration of object_i is now known. Compute velocity and position.
+        Vector3 acceleration   = BodyStore_acceleration( &body_store, object_i );
+        Vector3 delta_v        = v3_multiply( step, acceleration );
+        Vector3 delta_position = v3_multiply( step, current_dynamics[object_i].velocity );
 
         next_dynamics[object_i].velocity =
             v3_add( current_dynamics[object_i].velocity, delta_v );
@@ -49,6 +163,7 @@ void time_step( )
     ObjectDynamics *temp = current_dynamics;
     current_dynamics     = next_dynamics;
     next_dynamics        = temp;
+    return step;
 }
 
 